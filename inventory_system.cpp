@@ -1,349 +1,7599 @@
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <vector>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <deque>
+#include <functional>
+#include <queue>
+#include <memory>
 #include <algorithm>
+#include <string_view>
+#include <type_traits>
+#include <limits>
+#include <charconv>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+#include <filesystem>
+#include <cstdint>
+#include <cstdio>
+#include <chrono>
+#include <cstring>
+#include <cmath>
+#include <ctime>
 #include <iomanip>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#ifdef __linux__
+#include <cerrno>
+#include <csignal>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
 
 using namespace std;
 
-// Item class representing an inventory item
-class Item
+// Hot-path instrumentation; build with -DINVENTORY_STATS=0 to compile the timers out
+#ifndef INVENTORY_STATS
+#define INVENTORY_STATS 1
+#endif
+constexpr bool statsEnabled = INVENTORY_STATS != 0;
+
+// Instrumented operations
+enum class Metric
+{
+    Load,
+    Import,
+    Add,
+    DuplicateCheck,
+    Sort,
+    List,
+    Aggregate,
+    FileRead,
+    FileWrite,
+    Count
+};
+
+const char *const metricNames[] = {"load", "import", "add", "duplicate_check", "sort", "list", "aggregate", "file_read", "file_write"};
+
+// Counters and a power-of-two latency histogram (in nanoseconds) per metric, safe to update from any thread
+class Stats
 {
 private:
-    int itemID;
-    string itemName;
-    int quantity;
-    string registrationDate;
+    static constexpr unsigned bucketCount = 48;
+
+    struct Series
+    {
+        atomic<uint64_t> count{0};
+        atomic<uint64_t> totalNanos{0};
+        atomic<uint64_t> maxNanos{0};
+        atomic<uint64_t> bytes{0};
+        atomic<uint64_t> buckets[bucketCount] = {};
+    };
+
+    static Series &series(Metric metric)
+    {
+        static Series all[static_cast<size_t>(Metric::Count)];
+        return all[static_cast<size_t>(metric)];
+    }
+
+    // Function to estimate a percentile as the upper bound of the bucket it falls in
+    static uint64_t percentile(const Series &data, uint64_t count, double p)
+    {
+        uint64_t rank = static_cast<uint64_t>(p * count);
+        uint64_t seen = 0;
+        for (unsigned bucket = 0; bucket < bucketCount; ++bucket)
+        {
+            seen += data.buckets[bucket].load(memory_order_relaxed);
+            if (seen > rank)
+            {
+                return min(uint64_t(2) << bucket, data.maxNanos.load(memory_order_relaxed));
+            }
+        }
+        return data.maxNanos.load(memory_order_relaxed);
+    }
+
+public:
+    // Function to record one timed operation and the bytes it moved
+    static void record(Metric metric, uint64_t nanos, uint64_t bytes = 0)
+    {
+        Series &data = series(metric);
+        data.count.fetch_add(1, memory_order_relaxed);
+        data.totalNanos.fetch_add(nanos, memory_order_relaxed);
+        data.bytes.fetch_add(bytes, memory_order_relaxed);
+        uint64_t seenMax = data.maxNanos.load(memory_order_relaxed);
+        while (nanos > seenMax && !data.maxNanos.compare_exchange_weak(seenMax, nanos, memory_order_relaxed))
+        {
+        }
+        unsigned bucket = 0;
+        while (bucket + 1 < bucketCount && (nanos >> (bucket + 1)) != 0)
+        {
+            bucket += 1;
+        }
+        data.buckets[bucket].fetch_add(1, memory_order_relaxed);
+    }
+
+    static void reset()
+    {
+        for (size_t m = 0; m < static_cast<size_t>(Metric::Count); ++m)
+        {
+            Series &data = series(static_cast<Metric>(m));
+            data.count = 0;
+            data.totalNanos = 0;
+            data.maxNanos = 0;
+            data.bytes = 0;
+            for (auto &bucket : data.buckets)
+            {
+                bucket = 0;
+            }
+        }
+    }
+
+    // Function to print a table of every metric
+    static void print(ostream &out)
+    {
+        out << left << setw(16) << "metric" << right << setw(10) << "count" << setw(12) << "total ms" << setw(14) << "mean us"
+            << setw(14) << "p50 us" << setw(14) << "p99 us" << setw(14) << "max us" << setw(14) << "bytes" << "\n";
+        for (size_t m = 0; m < static_cast<size_t>(Metric::Count); ++m)
+        {
+            const Series &data = series(static_cast<Metric>(m));
+            uint64_t count = data.count.load(memory_order_relaxed);
+            uint64_t total = data.totalNanos.load(memory_order_relaxed);
+            out << left << setw(16) << metricNames[m] << right << setw(10) << count << fixed << setprecision(3)
+                << setw(12) << total / 1e6 << setw(14) << (count ? total / 1e3 / count : 0.0)
+                << setw(14) << percentile(data, count, 0.50) / 1e3 << setw(14) << percentile(data, count, 0.99) / 1e3
+                << setw(14) << data.maxNanos.load(memory_order_relaxed) / 1e3 << setw(14) << data.bytes.load(memory_order_relaxed)
+                << defaultfloat << "\n";
+        }
+    }
+
+    // Function to write every metric as one JSON object on a single line
+    static void printJson(ostream &out)
+    {
+        out << "{\"time\":" << chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count()
+            << ",\"metrics\":{";
+        for (size_t m = 0; m < static_cast<size_t>(Metric::Count); ++m)
+        {
+            const Series &data = series(static_cast<Metric>(m));
+            uint64_t count = data.count.load(memory_order_relaxed);
+            out << (m ? "," : "") << '"' << metricNames[m] << "\":{\"count\":" << count
+                << ",\"total_ns\":" << data.totalNanos.load(memory_order_relaxed)
+                << ",\"p50_ns\":" << percentile(data, count, 0.50) << ",\"p99_ns\":" << percentile(data, count, 0.99)
+                << ",\"max_ns\":" << data.maxNanos.load(memory_order_relaxed) << ",\"bytes\":" << data.bytes.load(memory_order_relaxed) << "}";
+        }
+        out << "}}\n";
+    }
+};
+
+// Times the enclosing scope into a metric; compiles to nothing when statistics are disabled
+class ScopedTimer
+{
+private:
+    Metric metric;
+    chrono::steady_clock::time_point started;
+
+public:
+    uint64_t bytes = 0;
+
+    explicit ScopedTimer(Metric timed)
+        : metric(timed)
+    {
+        if constexpr (statsEnabled)
+        {
+            started = chrono::steady_clock::now();
+        }
+    }
+
+    ~ScopedTimer()
+    {
+        if constexpr (statsEnabled)
+        {
+            auto nanos = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - started).count();
+            Stats::record(metric, static_cast<uint64_t>(nanos), bytes);
+        }
+    }
+
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+};
+
+// Appends a JSON line of statistics to a file at a fixed interval until it is destroyed
+class StatsExporter
+{
+private:
+    string path;
+    chrono::seconds interval;
+    thread worker;
+    mutex wakeMutex;
+    condition_variable wake;
+    bool stopping = false;
+
+    void write()
+    {
+        ofstream file(path, ios::app);
+        Stats::printJson(file);
+    }
+
+public:
+    StatsExporter(const string &file, chrono::seconds every)
+        : path(file), interval(every)
+    {
+        worker = thread([this]
+                        {
+            unique_lock<mutex> lock(wakeMutex);
+            while (!wake.wait_for(lock, interval, [this] { return stopping; }))
+            {
+                write();
+            } });
+    }
+
+    ~StatsExporter()
+    {
+        {
+            lock_guard<mutex> lock(wakeMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        worker.join();
+        write();
+    }
+
+    StatsExporter(const StatsExporter &) = delete;
+    StatsExporter &operator=(const StatsExporter &) = delete;
+};
+
+// Read-only view of a whole file, memory-mapped where the platform allows it
+class MappedFile
+{
+private:
+    const char *bytes = nullptr;
+    size_t length = 0;
+    bool mapped = false;
+    bool opened = false;
+    string fallback;
+
+public:
+    // Constructor
+    explicit MappedFile(const string &path)
+    {
+        ScopedTimer timer(Metric::FileRead);
+#ifndef _WIN32
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return;
+        }
+        opened = true;
+        struct stat st{};
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void *addr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED)
+            {
+                madvise(addr, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+                bytes = static_cast<const char *>(addr);
+                length = static_cast<size_t>(st.st_size);
+                mapped = true;
+                timer.bytes = length;
+            }
+        }
+        ::close(fd);
+        if (mapped || st.st_size == 0)
+        {
+            return;
+        }
+#endif
+        // fall back to reading the whole file into memory
+        ifstream file(path, ios::binary);
+        if (!file.is_open())
+        {
+            return;
+        }
+        opened = true;
+        fallback.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+        bytes = fallback.data();
+        length = fallback.size();
+        timer.bytes = length;
+    }
+
+    ~MappedFile()
+    {
+#ifndef _WIN32
+        if (mapped)
+        {
+            munmap(const_cast<char *>(bytes), length);
+        }
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool isOpen() const
+    {
+        return opened;
+    }
+
+    string_view view() const
+    {
+        return string_view(bytes, length);
+    }
+};
+
+// Identity of a file's contents as far as stat can tell; a rewrite through a rename changes the inode
+struct FileStamp
+{
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    uint64_t inode = 0;
+
+    bool operator==(const FileStamp &other) const
+    {
+        return size == other.size && mtime == other.mtime && inode == other.inode;
+    }
+};
+
+// Function to read the size, last write time (in nanoseconds) and inode of a file; false when it is missing
+bool readFileStamp(const string &path, FileStamp &stamp)
+{
+#ifndef _WIN32
+    struct stat st{};
+    if (::stat(path.c_str(), &st) != 0)
+    {
+        return false;
+    }
+    stamp.size = static_cast<uint64_t>(st.st_size);
+#ifdef __APPLE__
+    stamp.mtime = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    stamp.mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    stamp.inode = static_cast<uint64_t>(st.st_ino);
+    return true;
+#else
+    // no inode here; a rewrite still shows up as a changed size or write time
+    error_code ec;
+    auto fileSize = filesystem::file_size(path, ec);
+    auto writeTime = filesystem::last_write_time(path, ec);
+    if (ec)
+    {
+        return false;
+    }
+    stamp.size = fileSize;
+    stamp.mtime = static_cast<int64_t>(writeTime.time_since_epoch().count());
+    stamp.inode = 0;
+    return true;
+#endif
+}
+
+// Function to parse a whole decimal integer field, rejecting trailing garbage
+template <typename Integer>
+bool parseIntField(string_view field, Integer &value)
+{
+    const char *first = field.data();
+    const char *last = field.data() + field.size();
+    auto result = from_chars(first, last, value);
+    return result.ec == errc() && result.ptr == last;
+}
+
+// Function to check that a name can be stored: a comma or line break would split its CSV row
+bool validItemName(string_view name)
+{
+    return !name.empty() && name.find_first_of(",\r\n") == string_view::npos;
+}
+
+// Function to split one CSV line into its four item fields without copying
+bool parseItemLine(string_view line, int &id, string_view &name, int &quantity, string_view &regDate)
+{
+    if (!line.empty() && line.back() == '\r')
+    {
+        line.remove_suffix(1);
+    }
+    string_view fields[4];
+    size_t count = 0;
+    while (!line.empty())
+    {
+        if (count == 4)
+        {
+            return false;
+        }
+        const char *comma = static_cast<const char *>(memchr(line.data(), ',', line.size()));
+        size_t length = comma ? static_cast<size_t>(comma - line.data()) : line.size();
+        fields[count++] = line.substr(0, length);
+        line.remove_prefix(comma ? length + 1 : length);
+    }
+    if (count != 4 || !parseIntField(fields[0], id) || !parseIntField(fields[2], quantity))
+    {
+        return false;
+    }
+    name = fields[1];
+    regDate = fields[3];
+    return true;
+}
+
+// Function to skip JSON whitespace
+void skipJsonSpace(string_view &text)
+{
+    while (!text.empty() && (text[0] == ' ' || text[0] == '\t' || text[0] == '\r'))
+    {
+        text.remove_prefix(1);
+    }
+}
+
+// Function to read a JSON string; escaped strings are decoded into `decoded`, others stay views into text
+bool readJsonString(string_view &text, string_view &value, deque<string> &decoded)
+{
+    if (text.empty() || text[0] != '"')
+    {
+        return false;
+    }
+    text.remove_prefix(1);
+    size_t end = 0;
+    bool escaped = false;
+    while (end < text.size() && text[end] != '"')
+    {
+        if (text[end] == '\\')
+        {
+            escaped = true;
+            end += 1;
+        }
+        end += 1;
+    }
+    if (end >= text.size())
+    {
+        return false;
+    }
+    value = text.substr(0, end);
+    text.remove_prefix(end + 1);
+    if (escaped)
+    {
+        string plain;
+        for (size_t i = 0; i < value.size(); ++i)
+        {
+            char c = value[i];
+            if (c == '\\')
+            {
+                c = value[++i];
+                if (c == 'n')
+                {
+                    c = '\n';
+                }
+                else if (c == 't')
+                {
+                    c = '\t';
+                }
+                else if (c != '"' && c != '\\' && c != '/')
+                {
+                    return false; // \uXXXX and friends are not needed for item data
+                }
+            }
+            plain += c;
+        }
+        decoded.push_back(move(plain));
+        value = decoded.back();
+    }
+    return true;
+}
+
+// Function to parse one flat JSON object such as {"id":1,"name":"Pen","quantity":3,"date":"2023-01-01"}
+bool parseJsonItemLine(string_view line, int &id, string_view &name, int &quantity, string_view &regDate, deque<string> &decoded)
+{
+    bool haveId = false;
+    bool haveName = false;
+    bool haveQuantity = false;
+    bool haveDate = false;
+    skipJsonSpace(line);
+    if (line.empty() || line[0] != '{')
+    {
+        return false;
+    }
+    line.remove_prefix(1);
+    skipJsonSpace(line);
+    while (!line.empty() && line[0] != '}')
+    {
+        string_view key;
+        if (!readJsonString(line, key, decoded))
+        {
+            return false;
+        }
+        skipJsonSpace(line);
+        if (line.empty() || line[0] != ':')
+        {
+            return false;
+        }
+        line.remove_prefix(1);
+        skipJsonSpace(line);
+        if (!line.empty() && line[0] == '"')
+        {
+            string_view value;
+            if (!readJsonString(line, value, decoded))
+            {
+                return false;
+            }
+            if (key == "name")
+            {
+                name = value;
+                haveName = true;
+            }
+            else if (key == "date" || key == "registration_date")
+            {
+                regDate = value;
+                haveDate = true;
+            }
+        }
+        else
+        {
+            size_t end = 0;
+            while (end < line.size() && line[end] != ',' && line[end] != '}' && line[end] != ' ')
+            {
+                end += 1;
+            }
+            string_view value = line.substr(0, end);
+            line.remove_prefix(end);
+            if (key == "id")
+            {
+                haveId = parseIntField(value, id);
+            }
+            else if (key == "quantity")
+            {
+                haveQuantity = parseIntField(value, quantity);
+            }
+        }
+        skipJsonSpace(line);
+        if (!line.empty() && line[0] == ',')
+        {
+            line.remove_prefix(1);
+            skipJsonSpace(line);
+        }
+    }
+    return !line.empty() && haveId && haveName && haveQuantity && haveDate;
+}
+
+// Function to read one workload line: a JSON string holding a command, or an object with a "command" member
+bool parseJsonCommandLine(string_view line, string_view &command, deque<string> &decoded)
+{
+    skipJsonSpace(line);
+    if (!line.empty() && line[0] == '"')
+    {
+        return readJsonString(line, command, decoded);
+    }
+    if (line.empty() || line[0] != '{')
+    {
+        return false;
+    }
+    line.remove_prefix(1);
+    skipJsonSpace(line);
+    while (!line.empty() && line[0] != '}')
+    {
+        string_view key;
+        if (!readJsonString(line, key, decoded))
+        {
+            return false;
+        }
+        skipJsonSpace(line);
+        if (line.empty() || line[0] != ':')
+        {
+            return false;
+        }
+        line.remove_prefix(1);
+        skipJsonSpace(line);
+        if (!line.empty() && line[0] == '"')
+        {
+            string_view value;
+            if (!readJsonString(line, value, decoded))
+            {
+                return false;
+            }
+            if (key == "command")
+            {
+                command = value;
+                return true;
+            }
+        }
+        else
+        {
+            while (!line.empty() && line[0] != ',' && line[0] != '}')
+            {
+                line.remove_prefix(1);
+            }
+        }
+        skipJsonSpace(line);
+        if (!line.empty() && line[0] == ',')
+        {
+            line.remove_prefix(1);
+            skipJsonSpace(line);
+        }
+    }
+    return false;
+}
+
+// Function to count the days from 1970-01-01 to a civil date (proleptic Gregorian calendar)
+int32_t daysFromCivil(int year, unsigned month, unsigned day)
+{
+    year -= month <= 2;
+    int era = (year >= 0 ? year : year - 399) / 400;
+    unsigned yearOfEra = static_cast<unsigned>(year - era * 400);
+    unsigned dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + static_cast<int32_t>(dayOfEra) - 719468;
+}
+
+// Function to parse YYYY-MM-DD into days since 1970-01-01 without allocating; false when malformed
+bool parseDate(string_view text, int32_t &days)
+{
+    if (text.size() != 10 || text[4] != '-' || text[7] != '-')
+    {
+        return false;
+    }
+    unsigned digits[8];
+    const size_t positions[8] = {0, 1, 2, 3, 5, 6, 8, 9};
+    for (size_t i = 0; i < 8; ++i)
+    {
+        digits[i] = static_cast<unsigned char>(text[positions[i]]) - '0';
+        if (digits[i] > 9)
+        {
+            return false;
+        }
+    }
+    int year = static_cast<int>(digits[0] * 1000 + digits[1] * 100 + digits[2] * 10 + digits[3]);
+    unsigned month = digits[4] * 10 + digits[5];
+    unsigned day = digits[6] * 10 + digits[7];
+    static const unsigned char monthDays[12] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if (month < 1 || month > 12 || day < 1 || day > monthDays[month - 1])
+    {
+        return false;
+    }
+    bool leapYear = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    if (month == 2 && day == 29 && !leapYear)
+    {
+        return false;
+    }
+    days = daysFromCivil(year, month, day);
+    return true;
+}
+
+// Function to convert days since 1970-01-01 back to a civil date (proleptic Gregorian calendar)
+void civilFromDays(int32_t days, unsigned &year, unsigned &month, unsigned &day)
+{
+    days += 719468;
+    int era = (days >= 0 ? days : days - 146096) / 146097;
+    unsigned dayOfEra = static_cast<unsigned>(days - era * 146097);
+    unsigned yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    unsigned dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    unsigned monthIndex = (5 * dayOfYear + 2) / 153;
+    day = dayOfYear - (153 * monthIndex + 2) / 5 + 1;
+    month = monthIndex < 10 ? monthIndex + 3 : monthIndex - 9;
+    year = static_cast<unsigned>(static_cast<int>(yearOfEra) + era * 400 + (month <= 2));
+}
+
+// Function to write days since 1970-01-01 as YYYY-MM-DD into a 10-byte buffer
+void formatDate(int32_t days, char *out)
+{
+    unsigned year = 0;
+    unsigned month = 0;
+    unsigned day = 0;
+    civilFromDays(days, year, month, day);
+    out[0] = char('0' + year / 1000 % 10);
+    out[1] = char('0' + year / 100 % 10);
+    out[2] = char('0' + year / 10 % 10);
+    out[3] = char('0' + year % 10);
+    out[4] = '-';
+    out[5] = char('0' + month / 10);
+    out[6] = char('0' + month % 10);
+    out[7] = '-';
+    out[8] = char('0' + day / 10);
+    out[9] = char('0' + day % 10);
+}
+
+// Function to format days since 1970-01-01 as a YYYY-MM-DD string
+string formatDate(int32_t days)
+{
+    char buffer[10];
+    formatDate(days, buffer);
+    return string(buffer, sizeof(buffer));
+}
+
+// Function to compute a 64-bit FNV-1a checksum over a byte range
+uint64_t checksumBytes(const char *data, size_t length, uint64_t hash = 1469598103934665603ull)
+{
+    for (size_t i = 0; i < length; ++i)
+    {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Binary snapshot layout: SnapshotHeader, `count` SnapshotRecords, then the name string table
+struct SnapshotHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceSize;   // size of items.csv when the snapshot was taken
+    int64_t sourceMtime;   // last write time of items.csv when the snapshot was taken
+    uint64_t count;        // number of records
+    uint64_t stringBytes;  // size of the name string table
+    uint64_t checksum;     // FNV-1a over the records and the string table
+};
+
+struct SnapshotRecord
+{
+    int32_t id;
+    int32_t quantity;
+    int32_t date;          // days since 1970-01-01
+    uint32_t nameOffset;   // offset into the string table
+    uint32_t nameLength;
+};
+
+const char snapshotMagic[4] = {'I', 'N', 'V', 'S'};
+const uint32_t snapshotVersion = 2;
+
+// Item class representing an inventory item; the name is a view into the string pool of the table it
+// came from, so an Item is trivially copyable and stays valid while that table (or ReadView) lives
+class Item
+{
+private:
+    int itemID;
+    string_view itemName;
+    int quantity;
+    int32_t registrationDay; // days since 1970-01-01
+
+public:
+    // Constructor
+    Item(int id, string_view name, int qty, int32_t regDay)
+        : itemID(id), itemName(name), quantity(qty), registrationDay(regDay) {}
+
+    // Getter methods
+    int getItemID() const
+    {
+        return itemID;
+    }
+
+    string_view getItemName() const
+    {
+        return itemName;
+    }
+
+    int getQuantity() const
+    {
+        return quantity;
+    }
+
+    int32_t getRegistrationDay() const
+    {
+        return registrationDay;
+    }
+};
+static_assert(is_trivially_copyable_v<Item>, "Item must stay a plain view so copies never allocate");
+
+// Append-only arena of interned strings, addressed by 32-bit handles (block index and offset); handles
+// and the bytes behind them stay valid until the pool is destroyed
+class StringPool
+{
+private:
+    static constexpr size_t blockSize = 64 * 1024;
+    static constexpr size_t maxBlocks = 65535;
+    // reserved up front and never reallocated, so readers of published views can resolve handles while
+    // the writer appends new blocks
+    vector<unique_ptr<char[]>> blocks;
+    size_t blockUsed = blockSize;
+    size_t count = 0;
+    // open-addressed set of interned strings: each slot packs the high hash bits with handle + 1 (0 when
+    // empty), so most probes are rejected without touching the string
+    vector<uint64_t> slots;
+
+    // Function to copy a length-prefixed string into the arena, opening a new block when the current one
+    // is full; strings longer than a block get a block of their own
+    uint32_t store(string_view text)
+    {
+        size_t prefix = text.size() < 255 ? 1 : 5;
+        size_t needed = prefix + text.size();
+        if (needed > blockSize - blockUsed)
+        {
+            if (blocks.size() >= maxBlocks)
+            {
+                throw length_error("string pool is full");
+            }
+            blocks.emplace_back(new char[max(blockSize, needed)]);
+            blockUsed = 0;
+        }
+        uint32_t handle = static_cast<uint32_t>((blocks.size() - 1) << 16 | blockUsed);
+        char *target = blocks.back().get() + blockUsed;
+        if (prefix == 1)
+        {
+            target[0] = static_cast<char>(text.size());
+        }
+        else
+        {
+            uint32_t length = static_cast<uint32_t>(text.size());
+            target[0] = static_cast<char>(255);
+            memcpy(target + 1, &length, sizeof(length));
+        }
+        memcpy(target + prefix, text.data(), text.size());
+        // an oversized string fills its block, so the next string starts a new one
+        blockUsed = needed > blockSize ? blockSize : blockUsed + needed;
+        return handle;
+    }
+
+    // Function to resize the slot array to at least `minimum` slots and re-place every entry
+    void grow(size_t minimum)
+    {
+        size_t capacity = max<size_t>(1024, slots.size());
+        while (capacity < minimum)
+        {
+            capacity *= 2;
+        }
+        vector<uint64_t> bigger(capacity, 0);
+        size_t mask = bigger.size() - 1;
+        for (uint64_t entry : slots)
+        {
+            if (entry == 0)
+            {
+                continue;
+            }
+            size_t slot = (entry >> 32) & mask;
+            while (bigger[slot] != 0)
+            {
+                slot = (slot + 1) & mask;
+            }
+            bigger[slot] = entry;
+        }
+        slots.swap(bigger);
+    }
+
+public:
+    // Constructor
+    StringPool()
+    {
+        blocks.reserve(maxBlocks);
+    }
+
+    StringPool(const StringPool &) = delete;
+    StringPool &operator=(const StringPool &) = delete;
+
+    // Function to size the set for an expected number of distinct strings (kept at most 3/4 full)
+    void reserve(size_t expected)
+    {
+        if (expected * 4 > slots.size() * 3)
+        {
+            grow(expected * 4 / 3 + 1);
+        }
+    }
+
+    // Function to return the bytes behind a handle
+    string_view view(uint32_t handle) const
+    {
+        const char *entry = blocks[handle >> 16].get() + (handle & 0xFFFF);
+        uint32_t length = static_cast<unsigned char>(entry[0]);
+        if (length != 255)
+        {
+            return string_view(entry + 1, length);
+        }
+        memcpy(&length, entry + 1, sizeof(length));
+        return string_view(entry + 5, length);
+    }
+
+    // Function to return the handle of the pooled copy of a string, storing it on first sight
+    uint32_t intern(string_view text)
+    {
+        if ((count + 1) * 4 > slots.size() * 3)
+        {
+            grow(slots.size() * 2);
+        }
+        size_t mask = slots.size() - 1;
+        uint64_t tag = static_cast<uint64_t>(hash<string_view>()(text) >> 32) << 32;
+        size_t slot = (tag >> 32) & mask;
+        while (slots[slot] != 0)
+        {
+            uint32_t handle = static_cast<uint32_t>((slots[slot] & 0xFFFFFFFFull) - 1);
+            if ((slots[slot] & ~0xFFFFFFFFull) == tag && view(handle) == text)
+            {
+                return handle;
+            }
+            slot = (slot + 1) & mask;
+        }
+        uint32_t handle = store(text);
+        slots[slot] = tag | (static_cast<uint64_t>(handle) + 1);
+        count += 1;
+        return handle;
+    }
+};
+
+// Totals over a set of quantities
+struct QuantityStats
+{
+    uint64_t count = 0;
+    int64_t total = 0;
+    int32_t minimum = INT32_MAX;
+    int32_t maximum = INT32_MIN;
+    uint64_t below = 0; // quantities under the threshold
+
+    void add(int32_t quantity, int32_t threshold)
+    {
+        count += 1;
+        total += quantity;
+        minimum = min(minimum, quantity);
+        maximum = max(maximum, quantity);
+        below += quantity < threshold;
+    }
+
+    void merge(const QuantityStats &other)
+    {
+        count += other.count;
+        total += other.total;
+        minimum = min(minimum, other.minimum);
+        maximum = max(maximum, other.maximum);
+        below += other.below;
+    }
+};
+
+// Function to aggregate the live entries of a quantity column with a plain loop; also handles the tail
+// the vector kernel leaves over
+QuantityStats aggregateQuantitiesScalar(const int32_t *quantities, const uint8_t *live, size_t count, int32_t threshold)
+{
+    QuantityStats stats;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (live[i])
+        {
+            stats.add(quantities[i], threshold);
+        }
+    }
+    return stats;
+}
+
+// Function to aggregate the live entries of a quantity column, 16 rows per step with SSE2 (part of every
+// x86-64 target, so no extra build flags are needed); removed rows are masked out rather than branched on
+QuantityStats aggregateQuantities(const int32_t *quantities, const uint8_t *live, size_t count, int32_t threshold)
+{
+    size_t done = 0;
+    QuantityStats stats;
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i allOnes = _mm_set1_epi32(-1);
+    const __m128i limit = _mm_set1_epi32(threshold);
+    const __m128i largest = _mm_set1_epi32(INT32_MAX);
+    const __m128i smallest = _mm_set1_epi32(INT32_MIN);
+    __m128i sums = zero; // two 64-bit lanes
+    __m128i lows = largest;
+    __m128i highs = smallest;
+    __m128i belowLanes = zero;
+    __m128i liveLanes = zero;
+    for (; done + 16 <= count; done += 16)
+    {
+        // widen the 16 live flags into four masks of four 32-bit lanes, all ones where the row is removed
+        __m128i dead = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(live + done)), zero);
+        __m128i deadLow = _mm_unpacklo_epi8(dead, dead);
+        __m128i deadHigh = _mm_unpackhi_epi8(dead, dead);
+        const __m128i masks[4] = {_mm_unpacklo_epi16(deadLow, deadLow), _mm_unpackhi_epi16(deadLow, deadLow),
+                                  _mm_unpacklo_epi16(deadHigh, deadHigh), _mm_unpackhi_epi16(deadHigh, deadHigh)};
+        for (int part = 0; part < 4; ++part)
+        {
+            __m128i mask = masks[part];
+            __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i *>(quantities + done + part * 4));
+            __m128i kept = _mm_andnot_si128(mask, values);
+            __m128i sign = _mm_srai_epi32(kept, 31);
+            sums = _mm_add_epi64(sums, _mm_unpacklo_epi32(kept, sign));
+            sums = _mm_add_epi64(sums, _mm_unpackhi_epi32(kept, sign));
+            // removed rows take the identity of min and max; SSE2 has no 32-bit min/max, so compare and select
+            __m128i forMin = _mm_or_si128(kept, _mm_and_si128(mask, largest));
+            __m128i forMax = _mm_or_si128(kept, _mm_and_si128(mask, smallest));
+            __m128i less = _mm_cmplt_epi32(forMin, lows);
+            lows = _mm_or_si128(_mm_and_si128(less, forMin), _mm_andnot_si128(less, lows));
+            __m128i greater = _mm_cmpgt_epi32(forMax, highs);
+            highs = _mm_or_si128(_mm_and_si128(greater, forMax), _mm_andnot_si128(greater, highs));
+            // compare masks are -1, so subtracting them counts
+            belowLanes = _mm_sub_epi32(belowLanes, _mm_andnot_si128(mask, _mm_cmplt_epi32(values, limit)));
+            liveLanes = _mm_sub_epi32(liveLanes, _mm_andnot_si128(mask, allOnes));
+        }
+    }
+    alignas(16) int64_t sumParts[2];
+    alignas(16) int32_t lowParts[4];
+    alignas(16) int32_t highParts[4];
+    alignas(16) uint32_t belowParts[4];
+    alignas(16) uint32_t liveParts[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(sumParts), sums);
+    _mm_store_si128(reinterpret_cast<__m128i *>(lowParts), lows);
+    _mm_store_si128(reinterpret_cast<__m128i *>(highParts), highs);
+    _mm_store_si128(reinterpret_cast<__m128i *>(belowParts), belowLanes);
+    _mm_store_si128(reinterpret_cast<__m128i *>(liveParts), liveLanes);
+    stats.total = sumParts[0] + sumParts[1];
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        stats.minimum = min(stats.minimum, lowParts[lane]);
+        stats.maximum = max(stats.maximum, highParts[lane]);
+        stats.below += belowParts[lane];
+        stats.count += liveParts[lane];
+    }
+#endif
+    stats.merge(aggregateQuantitiesScalar(quantities + done, live + done, count - done, threshold));
+    return stats;
+}
+
+// Function to aggregate the live entries of a quantity column per registration month, as
+// (year * 12 + month - 1, totals) pairs in month order. Days map to months through a table covering the
+// span of registration dates, so each row costs one lookup instead of a calendar conversion
+void aggregateQuantitiesByMonth(const int32_t *quantities, const int32_t *dates, const uint8_t *live, size_t count,
+                                int32_t threshold, vector<pair<int32_t, QuantityStats>> &months)
+{
+    // the date range comes out of the same kernel, run over the date column
+    QuantityStats span = aggregateQuantities(dates, live, count, 0);
+    if (span.count == 0)
+    {
+        return;
+    }
+    unsigned year = 0;
+    unsigned month = 0;
+    unsigned day = 0;
+    civilFromDays(span.minimum, year, month, day);
+    int32_t firstMonth = static_cast<int32_t>(year * 12 + month - 1);
+    vector<uint32_t> monthOfDay(static_cast<size_t>(int64_t(span.maximum) - span.minimum + 1));
+    uint32_t current = 0;
+    for (size_t offset = 0; offset < monthOfDay.size(); ++offset)
+    {
+        civilFromDays(span.minimum + static_cast<int32_t>(offset), year, month, day);
+        current += day == 1 && offset != 0;
+        monthOfDay[offset] = current;
+    }
+
+    vector<QuantityStats> groups(current + 1);
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (live[i])
+        {
+            groups[monthOfDay[static_cast<size_t>(dates[i] - span.minimum)]].add(quantities[i], threshold);
+        }
+    }
+    for (uint32_t group = 0; group < groups.size(); ++group)
+    {
+        if (groups[group].count != 0)
+        {
+            months.emplace_back(firstMonth + static_cast<int32_t>(group), groups[group]);
+        }
+    }
+}
+
+// Struct-of-arrays item storage: each field lives in its own contiguous column
+class ItemTable
+{
+private:
+    vector<int32_t> ids;
+    vector<int32_t> quantities;
+    vector<int32_t> dates;    // days since 1970-01-01
+    vector<uint32_t> names;   // handles into namePool
+    vector<uint8_t> live;     // 0 once a row is removed; removed rows keep their slot until the next load
+    size_t liveRows = 0;
+    // shared so copies of the table (published read views) keep the name bytes alive; the pool only
+    // ever appends, so bytes and block pointers a copy can see are never written again
+    shared_ptr<StringPool> namePool = make_shared<StringPool>();
+
+public:
+    size_t size() const
+    {
+        return ids.size();
+    }
+
+    bool empty() const
+    {
+        return ids.empty();
+    }
+
+    // Function to count the rows that have not been removed
+    size_t liveCount() const
+    {
+        return liveRows;
+    }
+
+    void reserve(size_t count)
+    {
+        ids.reserve(count);
+        quantities.reserve(count);
+        dates.reserve(count);
+        names.reserve(count);
+        live.reserve(count);
+        namePool->reserve(count);
+    }
+
+    void clear()
+    {
+        ids.clear();
+        quantities.clear();
+        dates.clear();
+        names.clear();
+        live.clear();
+        liveRows = 0;
+        namePool = make_shared<StringPool>();
+    }
+
+    // Function to append a row; the name is interned so callers may pass short-lived views
+    void push_back(int32_t id, string_view name, int32_t quantity, int32_t date)
+    {
+        ids.push_back(id);
+        quantities.push_back(quantity);
+        dates.push_back(date);
+        names.push_back(namePool->intern(name));
+        live.push_back(1);
+        liveRows += 1;
+    }
+
+    void setQuantity(size_t slot, int32_t quantity)
+    {
+        quantities[slot] = quantity;
+    }
+
+    // Function to tombstone a row in place
+    void remove(size_t slot)
+    {
+        if (live[slot])
+        {
+            live[slot] = 0;
+            liveRows -= 1;
+        }
+    }
+
+    bool isLive(size_t slot) const
+    {
+        return live[slot] != 0;
+    }
+
+    int32_t id(size_t slot) const
+    {
+        return ids[slot];
+    }
+
+    int32_t quantity(size_t slot) const
+    {
+        return quantities[slot];
+    }
+
+    int32_t date(size_t slot) const
+    {
+        return dates[slot];
+    }
+
+    string_view name(size_t slot) const
+    {
+        return namePool->view(names[slot]);
+    }
+
+    // Function to materialise one row as an Item
+    Item item(size_t slot) const
+    {
+        return Item(ids[slot], name(slot), quantities[slot], dates[slot]);
+    }
+
+    // Function to sum the quantity column
+    int64_t totalQuantity() const
+    {
+        return aggregateQuantities(quantities.data(), live.data(), quantities.size(), 0).total;
+    }
+
+    // Function to aggregate the quantities of the live rows, counting those under a threshold
+    QuantityStats quantityStats(int32_t threshold) const
+    {
+        return aggregateQuantities(quantities.data(), live.data(), quantities.size(), threshold);
+    }
+
+    // Function to aggregate the quantities of the live rows per registration month
+    void quantityStatsByMonth(int32_t threshold, vector<pair<int32_t, QuantityStats>> &months) const
+    {
+        aggregateQuantitiesByMonth(quantities.data(), dates.data(), live.data(), quantities.size(), threshold, months);
+    }
+
+    // Function to count rows registered strictly after a date
+    size_t countRegisteredAfter(int32_t date) const
+    {
+        size_t count = 0;
+        for (size_t slot = 0; slot < dates.size(); ++slot)
+        {
+            count += live[slot] && dates[slot] > date;
+        }
+        return count;
+    }
+};
+
+// Flat open-addressed map from item ID to slot; a plain vector, so copying it is a memcpy
+class IdIndex
+{
+private:
+    // each entry packs the ID in the high half and slot + 1 in the low half; 0 marks an empty entry
+    vector<uint64_t> entries;
+    size_t count = 0;
+    unsigned shift = 64;
+
+    size_t home(int32_t id) const
+    {
+        return static_cast<size_t>((static_cast<uint64_t>(static_cast<uint32_t>(id)) * 0x9E3779B97F4A7C15ull) >> shift);
+    }
+
+    static int32_t entryId(uint64_t entry)
+    {
+        return static_cast<int32_t>(static_cast<uint32_t>(entry >> 32));
+    }
+
+    // Function to resize to at least `minimum` entries and re-place every ID
+    void grow(size_t minimum)
+    {
+        size_t capacity = max<size_t>(1024, entries.size());
+        while (capacity < minimum)
+        {
+            capacity *= 2;
+        }
+        vector<uint64_t> old;
+        old.swap(entries);
+        entries.assign(capacity, 0);
+        shift = 64;
+        for (size_t bits = capacity; bits > 1; bits >>= 1)
+        {
+            shift -= 1;
+        }
+        size_t mask = capacity - 1;
+        for (uint64_t entry : old)
+        {
+            if (entry != 0)
+            {
+                size_t position = home(entryId(entry));
+                while (entries[position] != 0)
+                {
+                    position = (position + 1) & mask;
+                }
+                entries[position] = entry;
+            }
+        }
+    }
+
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    // Function to size the map for an expected number of IDs (kept at most 3/4 full)
+    void reserve(size_t expected)
+    {
+        if (expected * 4 > entries.size() * 3)
+        {
+            grow(expected * 4 / 3 + 1);
+        }
+    }
+
+    void clear()
+    {
+        entries.clear();
+        count = 0;
+        shift = 64;
+    }
+
+    // Function to return the slot of an ID, or npos
+    size_t find(int32_t id) const
+    {
+        if (entries.empty())
+        {
+            return npos;
+        }
+        size_t mask = entries.size() - 1;
+        for (size_t position = home(id); entries[position] != 0; position = (position + 1) & mask)
+        {
+            if (entryId(entries[position]) == id)
+            {
+                return static_cast<size_t>(entries[position] & 0xFFFFFFFFull) - 1;
+            }
+        }
+        return npos;
+    }
+
+    bool contains(int32_t id) const
+    {
+        return find(id) != npos;
+    }
+
+    // Function to map an ID to a slot; false (and no change) when the ID is already present
+    bool insert(int32_t id, size_t slot)
+    {
+        if ((count + 1) * 4 > entries.size() * 3)
+        {
+            grow(entries.size() * 2);
+        }
+        size_t mask = entries.size() - 1;
+        size_t position = home(id);
+        while (entries[position] != 0)
+        {
+            if (entryId(entries[position]) == id)
+            {
+                return false;
+            }
+            position = (position + 1) & mask;
+        }
+        entries[position] = static_cast<uint64_t>(static_cast<uint32_t>(id)) << 32 | (slot + 1);
+        count += 1;
+        return true;
+    }
+
+    // Function to remove an ID, shifting later entries of its probe run back so lookups stay tombstone-free
+    void erase(int32_t id)
+    {
+        if (entries.empty())
+        {
+            return;
+        }
+        size_t mask = entries.size() - 1;
+        size_t hole = home(id);
+        while (entries[hole] != 0 && entryId(entries[hole]) != id)
+        {
+            hole = (hole + 1) & mask;
+        }
+        if (entries[hole] == 0)
+        {
+            return;
+        }
+        count -= 1;
+        for (size_t next = (hole + 1) & mask; entries[next] != 0; next = (next + 1) & mask)
+        {
+            size_t wanted = home(entryId(entries[next]));
+            // move the entry back when its home is not inside the (hole, next] stretch of the run
+            bool between = hole <= next ? (hole < wanted && wanted <= next) : (hole < wanted || wanted <= next);
+            if (!between)
+            {
+                entries[hole] = entries[next];
+                hole = next;
+            }
+        }
+        entries[hole] = 0;
+    }
+};
+
+// Ordered index over one int32 column of an ItemTable: (key, slot) pairs packed into integers kept sorted,
+// plus a small sorted buffer of recent changes that is merged in once it grows. An entry goes stale when its
+// row is removed or its key changes; queries skip stale entries and merges drop them, so a change costs
+// O(buffer) rather than an O(N) shift. The index is only built once something queries it.
+class SecondaryIndex
+{
+private:
+    int32_t (ItemTable::*column)(size_t) const;
+    vector<uint64_t> entries;
+    vector<uint64_t> pending;
+    size_t staleCount = 0;
+    bool built = false;
+
+    // keys are biased so negative keys sort first when the packed integers are compared
+    static uint64_t pack(int32_t key, uint32_t slot)
+    {
+        return static_cast<uint64_t>(static_cast<uint32_t>(key) ^ 0x80000000u) << 32 | slot;
+    }
+
+    static int32_t keyOf(uint64_t entry)
+    {
+        return static_cast<int32_t>(static_cast<uint32_t>(entry >> 32) ^ 0x80000000u);
+    }
+
+    bool current(const ItemTable &items, uint64_t entry) const
+    {
+        size_t slot = static_cast<uint32_t>(entry);
+        return items.isLive(slot) && (items.*column)(slot) == keyOf(entry);
+    }
+
+    // Function to fold the buffer into the sorted entries, dropping stale and repeated entries
+    void merge(const ItemTable &items)
+    {
+        vector<uint64_t> merged;
+        merged.reserve(entries.size() + pending.size() - min(staleCount, entries.size()));
+        size_t i = 0;
+        size_t j = 0;
+        while (i < entries.size() || j < pending.size())
+        {
+            uint64_t next = j == pending.size() || (i < entries.size() && entries[i] < pending[j]) ? entries[i++] : pending[j++];
+            if ((merged.empty() || merged.back() != next) && current(items, next))
+            {
+                merged.push_back(next);
+            }
+        }
+        entries.swap(merged);
+        pending.clear();
+        staleCount = 0;
+    }
+
+public:
+    // Constructor
+    explicit SecondaryIndex(int32_t (ItemTable::*keyColumn)(size_t) const)
+        : column(keyColumn) {}
+
+    void clear()
+    {
+        entries.clear();
+        pending.clear();
+        staleCount = 0;
+        built = false;
+    }
+
+    // Function to index every live row, unless that has been done already
+    void build(const ItemTable &items)
+    {
+        if (built)
+        {
+            return;
+        }
+        entries.clear();
+        entries.reserve(items.liveCount());
+        for (size_t slot = 0; slot < items.size(); ++slot)
+        {
+            if (items.isLive(slot))
+            {
+                entries.push_back(pack((items.*column)(slot), static_cast<uint32_t>(slot)));
+            }
+        }
+        sort(entries.begin(), entries.end());
+        built = true;
+    }
+
+    // Function to record that a row now holds `key`: a new row, or one whose key changed (its old entry is
+    // then stale)
+    void insert(const ItemTable &items, int32_t key, size_t slot, bool replacesEntry)
+    {
+        if (!built)
+        {
+            return;
+        }
+        uint64_t entry = pack(key, static_cast<uint32_t>(slot));
+        auto position = lower_bound(pending.begin(), pending.end(), entry);
+        if (position == pending.end() || *position != entry)
+        {
+            pending.insert(position, entry);
+        }
+        staleCount += replacesEntry;
+        if (pending.size() > 1024 + entries.size() / 1024)
+        {
+            merge(items);
+        }
+    }
+
+    // Function to note that a row was removed; the index is compacted once half of it is stale
+    void markStale(const ItemTable &items)
+    {
+        if (!built)
+        {
+            return;
+        }
+        staleCount += 1;
+        if (staleCount > 1024 + entries.size() / 2)
+        {
+            merge(items);
+        }
+    }
+
+    // Function to collect the slots of live rows with low <= key <= high, ordered by key and then slot
+    void query(const ItemTable &items, int32_t low, int32_t high, vector<uint32_t> &slots) const
+    {
+        if (low > high)
+        {
+            return;
+        }
+        uint64_t first = pack(low, 0);
+        uint64_t last = pack(high, UINT32_MAX);
+        auto i = lower_bound(entries.begin(), entries.end(), first);
+        auto iEnd = upper_bound(i, entries.end(), last);
+        auto j = lower_bound(pending.begin(), pending.end(), first);
+        auto jEnd = upper_bound(j, pending.end(), last);
+        uint64_t previous = 0;
+        bool any = false;
+        while (i != iEnd || j != jEnd)
+        {
+            uint64_t next = j == jEnd || (i != iEnd && *i < *j) ? *i++ : *j++;
+            if ((!any || next != previous) && current(items, next))
+            {
+                slots.push_back(static_cast<uint32_t>(next));
+                previous = next;
+                any = true;
+            }
+        }
+    }
+};
+
+// One parsed CSV row; name points into the mapped file until the row is stored
+struct ParsedRow
+{
+    int32_t id;
+    int32_t quantity;
+    int32_t date;
+    string_view name;
+};
+
+// Result of parsing one newline-aligned byte range of the items file
+struct ParsedChunk
+{
+    vector<ParsedRow> rows;
+    size_t lines = 0;    // lines consumed, including the invalid one if any
+    bool valid = true;   // false when the range stopped at an invalid line
+    bool torn = false;   // the invalid line is an unterminated last line, i.e. an interrupted write
+};
+
+// Function to parse every line of a byte range into a chunk-local row buffer
+void parseItemRange(string_view range, ParsedChunk &chunk)
+{
+    while (!range.empty())
+    {
+        const char *newline = static_cast<const char *>(memchr(range.data(), '\n', range.size()));
+        size_t length = newline ? static_cast<size_t>(newline - range.data()) : range.size();
+        string_view line = range.substr(0, length);
+        range.remove_prefix(newline ? length + 1 : length);
+        chunk.lines += 1;
+
+        int id = 0;
+        int quantity = 0;
+        string_view name;
+        string_view regDate;
+        int32_t date = 0;
+        if (!parseItemLine(line, id, name, quantity, regDate) || !parseDate(regDate, date))
+        {
+            chunk.valid = false;
+            chunk.torn = newline == nullptr;
+            return;
+        }
+        chunk.rows.push_back(ParsedRow{id, quantity, date, name});
+    }
+}
+
+// Function to split a buffer into at most `parts` ranges that each end on a line boundary
+vector<string_view> splitOnLines(string_view data, size_t parts)
+{
+    vector<string_view> ranges;
+    size_t begin = 0;
+    for (size_t part = 1; part <= parts && begin < data.size(); ++part)
+    {
+        size_t end = data.size();
+        if (part < parts)
+        {
+            end = max(begin, data.size() * part / parts);
+            size_t newline = data.find('\n', end);
+            end = newline == string_view::npos ? data.size() : newline + 1;
+        }
+        ranges.push_back(data.substr(begin, end - begin));
+        begin = end;
+    }
+    return ranges;
+}
+
+// Rows read from an import file; accepted rows point into the mapping or into decodedNames
+struct ImportBatch
+{
+    chrono::steady_clock::time_point started = chrono::steady_clock::now();
+    MappedFile file;
+    bool json;
+    vector<ParsedRow> accepted;
+    vector<size_t> acceptedLines;
+    vector<pair<size_t, string>> rejected;
+    deque<string> decodedNames;
+
+    explicit ImportBatch(const string &path)
+        : file(path)
+    {
+        string extension = filesystem::path(path).extension().string();
+        json = extension == ".jsonl" || extension == ".json";
+    }
+};
+
+// Function to validate every row of an import file; exists tells whether an ID is already stored
+template <typename Exists>
+void readImportRows(ImportBatch &batch, Exists exists)
+{
+    unordered_set<int> batchIds;
+    string_view rest = batch.file.view();
+    size_t lineNumber = 0;
+    while (!rest.empty())
+    {
+        const char *newline = static_cast<const char *>(memchr(rest.data(), '\n', rest.size()));
+        size_t length = newline ? static_cast<size_t>(newline - rest.data()) : rest.size();
+        string_view line = rest.substr(0, length);
+        rest.remove_prefix(newline ? length + 1 : length);
+        lineNumber += 1;
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.remove_suffix(1);
+        }
+        if (line.empty())
+        {
+            continue;
+        }
+
+        int id = 0;
+        int quantity = 0;
+        int32_t day = 0;
+        string_view name;
+        string_view regDate;
+        bool parsed = batch.json ? parseJsonItemLine(line, id, name, quantity, regDate, batch.decodedNames)
+                                 : parseItemLine(line, id, name, quantity, regDate);
+        if (!parsed)
+        {
+            batch.rejected.emplace_back(lineNumber, "malformed row");
+        }
+        else if (id < 0)
+        {
+            batch.rejected.emplace_back(lineNumber, "invalid ID");
+        }
+        else if (quantity < 0)
+        {
+            batch.rejected.emplace_back(lineNumber, "invalid quantity");
+        }
+        else if (!validItemName(name))
+        {
+            batch.rejected.emplace_back(lineNumber, "invalid name");
+        }
+        else if (!parseDate(regDate, day))
+        {
+            batch.rejected.emplace_back(lineNumber, "invalid date");
+        }
+        else if (exists(id) || !batchIds.insert(id).second)
+        {
+            batch.rejected.emplace_back(lineNumber, "item with ID " + to_string(id) + " already exists");
+        }
+        else
+        {
+            batch.accepted.push_back(ParsedRow{id, quantity, day, name});
+            batch.acceptedLines.push_back(lineNumber);
+        }
+    }
+}
+
+// Function to list the rejected rows of an import and report its throughput
+void reportImport(const ImportBatch &batch, ostream &out)
+{
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - batch.started).count();
+    size_t rows = batch.accepted.size() + batch.rejected.size();
+    const size_t maxReported = 20;
+    for (size_t i = 0; i < batch.rejected.size() && i < maxReported; ++i)
+    {
+        out << "Rejected line " << batch.rejected[i].first << ": " << batch.rejected[i].second << endl;
+    }
+    if (batch.rejected.size() > maxReported)
+    {
+        out << "... and " << batch.rejected.size() - maxReported << " more rejected lines" << endl;
+    }
+    out << "Imported " << batch.accepted.size() << " items, rejected " << batch.rejected.size() << " rows in "
+        << seconds << " s (" << static_cast<size_t>(seconds > 0 ? rows / seconds : rows) << " rows/sec)" << endl;
+}
+
+// How far a flushed batch is pushed towards the disk
+enum class Durability
+{
+    None,  // leave the rows to the C library and kernel buffers
+    Flush, // hand every batch to the kernel
+    Fsync  // hand every batch to the kernel and wait for the disk
+};
+
+// Append-only file writer that keeps its handle open and groups rows into batches
+class AppendWriter
+{
+private:
+    string fileName;
+    FILE *file = nullptr;
+    string buffer;
+    // a batch is written once it reaches batchBytes or has waited batchInterval; 0 bytes writes every row
+    size_t batchBytes = 0;
+    chrono::milliseconds batchInterval{0};
+    chrono::steady_clock::time_point batchStarted;
+    Durability durability = Durability::Flush;
+
+public:
+    // Constructor
+    explicit AppendWriter(const string &path)
+        : fileName(path) {}
+
+    ~AppendWriter()
+    {
+        close();
+    }
+
+    AppendWriter(const AppendWriter &) = delete;
+    AppendWriter &operator=(const AppendWriter &) = delete;
+
+    void setBatching(size_t bytes, chrono::milliseconds interval)
+    {
+        batchBytes = bytes;
+        batchInterval = interval;
+        flushIfDue();
+    }
+
+    void setDurability(Durability level)
+    {
+        durability = level;
+    }
+
+    size_t pendingBytes() const
+    {
+        return buffer.size();
+    }
+
+    // Function to queue a row; false when the file cannot be opened
+    bool append(string_view row)
+    {
+        if (file == nullptr)
+        {
+            file = fopen(fileName.c_str(), "ab");
+            if (file == nullptr)
+            {
+                return false;
+            }
+        }
+        if (buffer.empty())
+        {
+            batchStarted = chrono::steady_clock::now();
+        }
+        buffer.append(row.data(), row.size());
+        return flushIfDue();
+    }
+
+    // Function to write the batch when it is big enough or old enough
+    bool flushIfDue()
+    {
+        if (buffer.empty())
+        {
+            return true;
+        }
+        if (buffer.size() >= batchBytes || chrono::steady_clock::now() - batchStarted >= batchInterval)
+        {
+            return flush();
+        }
+        return true;
+    }
+
+    // Function to write the pending batch out at the configured durability
+    bool flush()
+    {
+        if (file == nullptr)
+        {
+            return buffer.empty();
+        }
+        ScopedTimer timer(Metric::FileWrite);
+        timer.bytes = buffer.size();
+        bool ok = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+        buffer.clear();
+        if (durability != Durability::None)
+        {
+            ok = fflush(file) == 0 && ok;
+        }
+        if (durability == Durability::Fsync)
+        {
+#ifdef _WIN32
+            ok = _commit(_fileno(file)) == 0 && ok;
+#else
+            ok = fsync(fileno(file)) == 0 && ok;
+#endif
+        }
+        return ok;
+    }
+
+    // Function to flush and release the handle, e.g. before the file is replaced
+    bool close()
+    {
+        if (file == nullptr)
+        {
+            return buffer.empty();
+        }
+        bool ok = flush();
+        ok = fclose(file) == 0 && ok;
+        file = nullptr;
+        return ok;
+    }
+};
+
+// Function to replace a file with new contents via a synced temporary file and a rename
+bool writeFileAtomically(const string &path, string_view bytes)
+{
+    ScopedTimer timer(Metric::FileWrite);
+    timer.bytes = bytes.size();
+    string tempName = path + ".tmp";
+    FILE *file = fopen(tempName.c_str(), "wb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    bool ok = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    ok = fflush(file) == 0 && ok;
+#ifdef _WIN32
+    ok = _commit(_fileno(file)) == 0 && ok;
+#else
+    ok = fsync(fileno(file)) == 0 && ok;
+#endif
+    ok = fclose(file) == 0 && ok;
+    error_code ec;
+    if (ok)
+    {
+        filesystem::rename(tempName, path, ec);
+    }
+    return ok && !ec;
+}
+
+// Write-ahead log operations
+enum class LogOp : uint8_t
+{
+    Add = 1,
+    Update = 2, // set the quantity of an existing item
+    Remove = 3
+};
+
+// One decoded log record; name points into the mapped log
+struct LogRecord
+{
+    LogOp op;
+    int32_t id;
+    int32_t quantity;
+    int32_t date;
+    string_view name;
+};
+
+// Log record framing: u32 payload length, u32 checksum of the payload, then the payload
+// (u8 op, i32 id, i32 quantity, i32 date, u32 name length, name bytes)
+const size_t logFrameBytes = 8;
+const size_t logFixedPayloadBytes = 17;
+
+// Function to fold the 64-bit checksum into the 32 bits stored per log record
+uint32_t logChecksum(const char *data, size_t length)
+{
+    uint64_t hash = checksumBytes(data, length);
+    return static_cast<uint32_t>(hash ^ (hash >> 32));
+}
+
+// Function to append one framed record to a log buffer
+void encodeLogRecord(string &out, LogOp op, int32_t id, int32_t quantity, int32_t date, string_view name)
+{
+    uint32_t payloadLength = static_cast<uint32_t>(logFixedPayloadBytes + name.size());
+    uint32_t nameLength = static_cast<uint32_t>(name.size());
+    size_t start = out.size();
+    out.resize(start + logFrameBytes + payloadLength);
+    char *payload = &out[start + logFrameBytes];
+    payload[0] = static_cast<char>(op);
+    memcpy(payload + 1, &id, 4);
+    memcpy(payload + 5, &quantity, 4);
+    memcpy(payload + 9, &date, 4);
+    memcpy(payload + 13, &nameLength, 4);
+    memcpy(payload + logFixedPayloadBytes, name.data(), name.size());
+    uint32_t checksum = logChecksum(payload, payloadLength);
+    memcpy(&out[start], &payloadLength, 4);
+    memcpy(&out[start + 4], &checksum, 4);
+}
+
+// Function to decode the record at the front of a log; false for a torn or corrupt record
+bool decodeLogRecord(string_view &rest, LogRecord &record)
+{
+    uint32_t payloadLength = 0;
+    uint32_t checksum = 0;
+    if (rest.size() < logFrameBytes)
+    {
+        return false;
+    }
+    memcpy(&payloadLength, rest.data(), 4);
+    memcpy(&checksum, rest.data() + 4, 4);
+    if (payloadLength < logFixedPayloadBytes || payloadLength > rest.size() - logFrameBytes)
+    {
+        return false;
+    }
+    const char *payload = rest.data() + logFrameBytes;
+    uint32_t nameLength = 0;
+    memcpy(&nameLength, payload + 13, 4);
+    if (logChecksum(payload, payloadLength) != checksum || logFixedPayloadBytes + nameLength != payloadLength)
+    {
+        return false;
+    }
+    record.op = static_cast<LogOp>(payload[0]);
+    memcpy(&record.id, payload + 1, 4);
+    memcpy(&record.quantity, payload + 5, 4);
+    memcpy(&record.date, payload + 9, 4);
+    record.name = string_view(payload + logFixedPayloadBytes, nameLength);
+    rest.remove_prefix(logFrameBytes + payloadLength);
+    return true;
+}
+
+// Callbacks a store streams its items into: reserve() announces how many base rows follow, apply() takes
+// the base rows (as Add records) and then the logged changes, in batches and in the order they apply
+struct RecordSink
+{
+    function<void(size_t)> reserve;
+    function<void(const LogRecord *, size_t)> apply;
+};
+
+// Records handed to a sink at a time
+const size_t sinkBatchRows = 4096;
+
+// Function to hand parsed rows to a sink as batches of Add records
+void applyParsedRows(const vector<ParsedRow> &rows, const RecordSink &sink)
+{
+    vector<LogRecord> batch;
+    batch.reserve(min(rows.size(), sinkBatchRows));
+    for (const auto &row : rows)
+    {
+        batch.push_back(LogRecord{LogOp::Add, row.id, row.quantity, row.date, row.name});
+        if (batch.size() == sinkBatchRows)
+        {
+            sink.apply(batch.data(), batch.size());
+            batch.clear();
+        }
+    }
+    if (!batch.empty())
+    {
+        sink.apply(batch.data(), batch.size());
+    }
+}
+
+// Function to parse CSV file contents into a sink, in parallel when more than one thread is allowed
+void parseCsvRows(string_view data, unsigned threads, const RecordSink &sink, ostream &out)
+{
+    // small files are not worth the thread start-up cost
+    const size_t minBytesPerThread = 1 << 20;
+    size_t parts = min<size_t>(threads, max<size_t>(1, data.size() / minBytesPerThread));
+    vector<string_view> ranges = splitOnLines(data, parts);
+    vector<ParsedChunk> chunks(ranges.size());
+    if (chunks.size() <= 1)
+    {
+        if (!ranges.empty())
+        {
+            parseItemRange(ranges[0], chunks[0]);
+        }
+    }
+    else
+    {
+        vector<thread> workers;
+        workers.reserve(ranges.size());
+        for (size_t i = 0; i < ranges.size(); ++i)
+        {
+            workers.emplace_back(parseItemRange, ranges[i], ref(chunks[i]));
+        }
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    // hand the chunks over in file order so duplicates and errors resolve exactly as a serial scan would
+    size_t total = 0;
+    for (const auto &chunk : chunks)
+    {
+        total += chunk.rows.size();
+    }
+    sink.reserve(total);
+    size_t lineNumber = 0;
+    for (auto &chunk : chunks)
+    {
+        applyParsedRows(chunk.rows, sink);
+        lineNumber += chunk.lines;
+        if (chunk.torn)
+        {
+            out << "Warning: ignoring the incomplete last line " << lineNumber << " of the file." << endl;
+        }
+        else if (!chunk.valid)
+        {
+            out << "Error: Invalid data in the file on line " << lineNumber << "." << endl;
+            break;
+        }
+    }
+}
+
+// Function to replay a log into a sink, cutting off a torn or corrupt tail; returns the bytes kept
+size_t replayLog(const string &path, const RecordSink &sink, ostream &out)
+{
+    size_t kept = 0;
+    bool torn = false;
+    {
+        MappedFile file(path);
+        if (!file.isOpen())
+        {
+            return 0;
+        }
+        string_view rest = file.view();
+        vector<LogRecord> batch;
+        LogRecord record;
+        while (decodeLogRecord(rest, record))
+        {
+            batch.push_back(record);
+            if (batch.size() == sinkBatchRows)
+            {
+                sink.apply(batch.data(), batch.size());
+                batch.clear();
+            }
+        }
+        if (!batch.empty())
+        {
+            sink.apply(batch.data(), batch.size());
+        }
+        kept = file.view().size() - rest.size();
+        torn = !rest.empty();
+    }
+    if (torn)
+    {
+        out << "Warning: discarding an incomplete record at the end of " << path << "." << endl;
+        error_code ec;
+        filesystem::resize_file(path, kept, ec);
+    }
+    return kept;
+}
+
+// Function to render the items at the given slots as CSV text, in that order
+string encodeCsv(const ItemTable &items, const vector<uint32_t> &order)
+{
+    string csv;
+    char digits[16];
+    for (uint32_t slot : order)
+    {
+        csv.append(digits, to_chars(digits, digits + sizeof(digits), items.id(slot)).ptr - digits);
+        csv += ',';
+        csv += items.name(slot);
+        csv += ',';
+        csv.append(digits, to_chars(digits, digits + sizeof(digits), items.quantity(slot)).ptr - digits);
+        csv += ',';
+        csv.append(10, ' ');
+        formatDate(items.date(slot), &csv[csv.size() - 10]);
+        csv += '\n';
+    }
+    return csv;
+}
+
+// Function to render the items at the given slots as a snapshot; the source stamp is left zero
+string encodeSnapshot(const ItemTable &items, const vector<uint32_t> &order)
+{
+    string strings;
+    vector<SnapshotRecord> records;
+    records.reserve(order.size());
+    for (uint32_t slot : order)
+    {
+        SnapshotRecord record;
+        record.id = items.id(slot);
+        record.quantity = items.quantity(slot);
+        record.date = items.date(slot);
+        string_view name = items.name(slot);
+        record.nameOffset = static_cast<uint32_t>(strings.size());
+        record.nameLength = static_cast<uint32_t>(name.size());
+        strings += name;
+        records.push_back(record);
+    }
+
+    SnapshotHeader header = {};
+    memcpy(header.magic, snapshotMagic, sizeof(snapshotMagic));
+    header.version = snapshotVersion;
+    header.count = records.size();
+    header.stringBytes = strings.size();
+    header.checksum = checksumBytes(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(SnapshotRecord));
+    header.checksum = checksumBytes(strings.data(), strings.size(), header.checksum);
+
+    string bytes(reinterpret_cast<const char *>(&header), sizeof(header));
+    bytes.append(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(SnapshotRecord));
+    bytes += strings;
+    return bytes;
+}
+
+// Function to read the header of a mapped snapshot; false when the file is missing or not a snapshot
+bool readSnapshotHeader(const MappedFile &file, SnapshotHeader &header)
+{
+    string_view data = file.view();
+    if (!file.isOpen() || data.size() < sizeof(header))
+    {
+        return false;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    return memcmp(header.magic, snapshotMagic, sizeof(snapshotMagic)) == 0 && header.version == snapshotVersion &&
+           data.size() == sizeof(header) + header.count * sizeof(SnapshotRecord) + header.stringBytes;
+}
+
+// Function to stream the records of a snapshot into a sink; false, before anything is streamed, when it is corrupt
+bool streamSnapshot(const MappedFile &file, const SnapshotHeader &header, const RecordSink &sink)
+{
+    string_view data = file.view();
+    const char *records = data.data() + sizeof(header);
+    const char *strings = records + header.count * sizeof(SnapshotRecord);
+    if (checksumBytes(records, data.size() - sizeof(header)) != header.checksum)
+    {
+        return false;
+    }
+    for (uint64_t i = 0; i < header.count; ++i)
+    {
+        SnapshotRecord record;
+        memcpy(&record, records + i * sizeof(record), sizeof(record));
+        if (uint64_t(record.nameOffset) + record.nameLength > header.stringBytes)
+        {
+            return false;
+        }
+    }
+
+    sink.reserve(header.count);
+    vector<LogRecord> batch;
+    batch.reserve(min<uint64_t>(header.count, sinkBatchRows));
+    for (uint64_t i = 0; i < header.count; ++i)
+    {
+        SnapshotRecord record;
+        memcpy(&record, records + i * sizeof(record), sizeof(record));
+        batch.push_back(LogRecord{LogOp::Add, record.id, record.quantity, record.date,
+                                  string_view(strings + record.nameOffset, record.nameLength)});
+        if (batch.size() == sinkBatchRows)
+        {
+            sink.apply(batch.data(), batch.size());
+            batch.clear();
+        }
+    }
+    if (!batch.empty())
+    {
+        sink.apply(batch.data(), batch.size());
+    }
+    return true;
+}
+
+// One item as a store returns it from a lookup
+struct StoredItem
+{
+    int32_t id = 0;
+    int32_t quantity = 0;
+    int32_t date = 0;
+    string name;
+    bool found = false;
+};
+
+// What a store saw when it checked its files for changes made by another process
+enum class StoreChange
+{
+    None,     // nothing changed
+    Appended, // new rows were appended; they went to the sink
+    Rewritten // the files were replaced; the items must be loaded again
+};
+
+// Where an Inventory keeps its items between runs. The inventory serves everything from memory and hands
+// the store its changes as batches of log records, so the same engine runs over any of the stores below.
+class ItemStore
+{
+protected:
+    // the items file the store was opened for; other files are named after it
+    string fileName;
+    // worker threads a store may use to parse its files
+    unsigned loadThreads = 1;
+
+    explicit ItemStore(const string &file)
+        : fileName(file) {}
+
+public:
+    virtual ~ItemStore() = default;
+
+    void setLoadThreads(unsigned threads)
+    {
+        loadThreads = threads;
+    }
+
+    // Function to stream every stored item into a sink; false when there is nothing to read from
+    virtual bool scan(const RecordSink &sink, ostream &out) = 0;
+
+    // Function to read the items at start-up; stores that watch their files note what they have read
+    virtual bool load(const RecordSink &sink, ostream &out)
+    {
+        return scan(sink, out);
+    }
+
+    // Function to store a batch of changes; false when they could not be written
+    virtual bool put(const LogRecord *records, size_t count) = 0;
+
+    // Function to look up a batch of IDs; rows gets one entry per ID, in the order asked for. A single
+    // scan answers the whole batch, since a file store has no index of its own.
+    virtual void get(const int32_t *ids, size_t count, vector<StoredItem> &rows, ostream &out)
+    {
+        rows.assign(count, StoredItem());
+        unordered_map<int32_t, size_t> wanted;
+        wanted.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            wanted.emplace(ids[i], i);
+        }
+        RecordSink sink;
+        sink.reserve = [](size_t) {};
+        sink.apply = [&](const LogRecord *records, size_t batch)
+        {
+            for (size_t i = 0; i < batch; ++i)
+            {
+                auto match = wanted.find(records[i].id);
+                if (match == wanted.end())
+                {
+                    continue;
+                }
+                StoredItem &row = rows[match->second];
+                // replayed like the inventory does: the first Add of an ID wins until it is removed
+                if (records[i].op == LogOp::Add && !row.found)
+                {
+                    row = StoredItem{records[i].id, records[i].quantity, records[i].date, string(records[i].name), true};
+                }
+                else if (records[i].op == LogOp::Update && row.found)
+                {
+                    row.quantity = records[i].quantity;
+                }
+                else if (records[i].op == LogOp::Remove)
+                {
+                    row.found = false;
+                }
+            }
+        };
+        scan(sink, out);
+        // repeated IDs share the row of their first occurrence
+        for (size_t i = 0; i < count; ++i)
+        {
+            size_t first = wanted[ids[i]];
+            if (first != i)
+            {
+                rows[i] = rows[first];
+            }
+        }
+    }
+
+    // Function to write out changes held back by batching
+    virtual bool flush()
+    {
+        return true;
+    }
+
+    // Function to write out a batch whose time threshold has passed
+    virtual bool flushIfDue()
+    {
+        return true;
+    }
+
+    virtual void setBatching(size_t, chrono::milliseconds) {}
+
+    virtual void setDurability(Durability) {}
+
+    virtual void setCompactThreshold(size_t) {}
+
+    // Function to tell whether enough changes piled up to make a checkpoint worthwhile
+    virtual bool checkpointDue() const
+    {
+        return false;
+    }
+
+    // Function to replace the stored items with the items at the given slots, in that order; the files are
+    // written on a background thread when asked to, so the caller only pays for encoding them
+    virtual bool checkpoint(const ItemTable &items, const vector<uint32_t> &order, bool background, ostream &out) = 0;
+
+    // Function to wait for a background checkpoint to finish
+    virtual void waitForCheckpoint() {}
+
+    // Function to tell whether a checkpoint is running in the background
+    virtual bool checkpointRunning() const
+    {
+        return false;
+    }
+
+    // Function to write the items at the given slots to the CSV file, in that order
+    virtual bool exportCsv(const ItemTable &items, const vector<uint32_t> &order, ostream &out)
+    {
+        if (!writeFileAtomically(fileName, encodeCsv(items, order)))
+        {
+            out << "Unable to write the file." << endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Function to write a snapshot that makes the next start faster
+    virtual bool saveSnapshot(const ItemTable &, const vector<uint32_t> &, ostream &)
+    {
+        return true;
+    }
+
+    // Function to tell whether saveSnapshot() would speed up the next start
+    virtual bool snapshotStale() const
+    {
+        return false;
+    }
+
+    // Function to tell whether the last load found the base file missing, so it must be written again
+    virtual bool baseMissing() const
+    {
+        return false;
+    }
+
+    // Function to check the files for changes made by another process; appended rows go to the sink
+    virtual StoreChange poll(const RecordSink &, ostream &)
+    {
+        return StoreChange::None;
+    }
+};
+
+// Base of the file stores: changes go to a write-ahead log next to the base file (items.csv -> items.wal)
+// until a checkpoint folds them into a new base file on a background thread
+class LoggedStore : public ItemStore
+{
+protected:
+    // the live log, and the log being folded in by a running or interrupted checkpoint
+    string logName;
+    string compactingLogName;
+    size_t logBytes = 0;
+    // a checkpoint is due once the log grows past this size
+    size_t compactThreshold = 4 << 20;
+    thread compactor;
+    atomic<bool> compactorDone{true};
+    // open append handle on the log that batches new records
+    AppendWriter writer;
+
+    explicit LoggedStore(const string &file)
+        : ItemStore(file), logName(filesystem::path(file).replace_extension(".wal").string()), compactingLogName(logName + ".old"),
+          writer(logName) {}
+
+    // Function to replay changes made since the last checkpoint: an interrupted checkpoint's log first, then the live log
+    void replayLogs(const RecordSink &sink, ostream &out)
+    {
+        replayLog(compactingLogName, sink, out);
+        logBytes = replayLog(logName, sink, out);
+    }
+
+    // Function to cut the log over so new changes flow into a new log while the old one is folded in
+    bool cutLog(ostream &out)
+    {
+        waitForCheckpoint();
+        if (!writer.close())
+        {
+            out << "Unable to write the file." << endl;
+            return false;
+        }
+        // a leftover compacting log from an interrupted checkpoint is already in memory; it is only
+        // replaced once the base file holding its changes is safely on disk, so in that case the live log stays put
+        error_code ec;
+        if (!filesystem::exists(compactingLogName, ec) && filesystem::exists(logName, ec))
+        {
+            filesystem::rename(logName, compactingLogName, ec);
+            if (ec)
+            {
+                out << "Unable to write the file." << endl;
+                return false;
+            }
+            logBytes = 0;
+        }
+        return true;
+    }
+
+    // Function to run the writes of a checkpoint, on a background thread when asked to
+    template <typename Task>
+    bool runCheckpoint(Task task, bool background)
+    {
+        auto run = [this, task = move(task)]() mutable
+        {
+            bool ok = task();
+            if (ok)
+            {
+                error_code ec;
+                filesystem::remove(compactingLogName, ec);
+            }
+            compactorDone = true;
+            return ok;
+        };
+        if (background)
+        {
+            compactorDone = false;
+            compactor = thread(move(run));
+            return true;
+        }
+        return run();
+    }
+
+public:
+    bool put(const LogRecord *records, size_t count) override
+    {
+        string batch;
+        for (size_t i = 0; i < count; ++i)
+        {
+            encodeLogRecord(batch, records[i].op, records[i].id, records[i].quantity, records[i].date, records[i].name);
+        }
+        if (!writer.append(batch))
+        {
+            return false;
+        }
+        logBytes += batch.size();
+        return true;
+    }
+
+    bool flush() override
+    {
+        return writer.flush();
+    }
+
+    bool flushIfDue() override
+    {
+        return writer.flushIfDue();
+    }
+
+    void setBatching(size_t bytes, chrono::milliseconds interval) override
+    {
+        writer.setBatching(bytes, interval);
+    }
+
+    void setDurability(Durability level) override
+    {
+        writer.setDurability(level);
+    }
+
+    void setCompactThreshold(size_t bytes) override
+    {
+        compactThreshold = bytes;
+    }
+
+    bool checkpointDue() const override
+    {
+        return logBytes >= compactThreshold && compactorDone;
+    }
+
+    void waitForCheckpoint() override
+    {
+        if (compactor.joinable())
+        {
+            compactor.join();
+        }
+    }
+
+    bool checkpointRunning() const override
+    {
+        return !compactorDone;
+    }
+};
+
+// Store that keeps the items in items.csv, with a binary snapshot (items.csv -> items.bin) mirroring it so a
+// start can skip parsing the CSV; other processes may append to or rewrite the CSV while it is open
+class CsvStore : public LoggedStore
+{
+private:
+    string snapshotName;
+    // true while the snapshot on disk mirrors the CSV file
+    bool snapshotCurrent = false;
+    // the last load came from the snapshot because the CSV was gone
+    bool csvMissing = false;
+    // the CSV file as last read or written here, so poll() can tell when someone else changed it;
+    // csvBytesRead trails the file size while an appended last line is still incomplete
+    FileStamp csvStamp;
+    uint64_t csvBytesRead = 0;
+    // stamp of the CSV written by the last checkpoint, handed over once the checkpoint is done
+    FileStamp compactedStamp;
+    bool compactedStampReady = false;
+
+    // Function to read the size and last write time of the CSV file; false when it is missing
+    bool sourceStamp(uint64_t &size, int64_t &mtime) const
+    {
+        error_code ec;
+        auto fileSize = filesystem::file_size(fileName, ec);
+        if (ec)
+        {
+            return false;
+        }
+        auto writeTime = filesystem::last_write_time(fileName, ec);
+        if (ec)
+        {
+            return false;
+        }
+        size = fileSize;
+        mtime = static_cast<int64_t>(writeTime.time_since_epoch().count());
+        return true;
+    }
+
+    // Function to record which CSV file an encoded snapshot mirrors
+    void stampSnapshot(string &bytes) const
+    {
+        uint64_t size = 0;
+        int64_t mtime = 0;
+        sourceStamp(size, mtime);
+        memcpy(&bytes[offsetof(SnapshotHeader, sourceSize)], &size, sizeof(size));
+        memcpy(&bytes[offsetof(SnapshotHeader, sourceMtime)], &mtime, sizeof(mtime));
+    }
+
+    // Function to remember the CSV file as it is now, after all of it was read or rewritten
+    void noteCsvRead()
+    {
+        compactedStampReady = false;
+        if (!readFileStamp(fileName, csvStamp))
+        {
+            csvStamp = FileStamp();
+        }
+        csvBytesRead = csvStamp.size;
+    }
+
+    // Function to stream the snapshot when it still matches the CSV file, or else the CSV file, then the logs
+    bool readItems(const RecordSink &sink, ostream &out, bool &fromSnapshot, bool &missing)
+    {
+        fromSnapshot = false;
+        missing = false;
+        MappedFile snapshot(snapshotName);
+        SnapshotHeader header;
+        if (readSnapshotHeader(snapshot, header))
+        {
+            // a snapshot only stands in for the CSV it was taken from; a missing CSV leaves the snapshot authoritative
+            uint64_t size = 0;
+            int64_t mtime = 0;
+            missing = !sourceStamp(size, mtime);
+            if (missing || (size == header.sourceSize && mtime == header.sourceMtime))
+            {
+                fromSnapshot = streamSnapshot(snapshot, header, sink);
+                if (!fromSnapshot)
+                {
+                    out << "Warning: snapshot " << snapshotName << " is corrupt, loading " << fileName << " instead." << endl;
+                    missing = false;
+                }
+            }
+        }
+        if (!fromSnapshot)
+        {
+            MappedFile file(fileName);
+            if (file.isOpen())
+            {
+                parseCsvRows(file.view(), loadThreads, sink, out);
+            }
+            else if (!filesystem::exists(logName))
+            {
+                return false;
+            }
+        }
+        replayLogs(sink, out);
+        return true;
+    }
+
+public:
+    // Constructor
+    explicit CsvStore(const string &file)
+        : LoggedStore(file), snapshotName(filesystem::path(file).replace_extension(".bin").string()) {}
+
+    ~CsvStore() override
+    {
+        waitForCheckpoint();
+    }
+
+    bool scan(const RecordSink &sink, ostream &out) override
+    {
+        bool fromSnapshot = false;
+        bool missing = false;
+        return readItems(sink, out, fromSnapshot, missing);
+    }
+
+    bool load(const RecordSink &sink, ostream &out) override
+    {
+        bool fromSnapshot = false;
+        if (!readItems(sink, out, fromSnapshot, csvMissing))
+        {
+            return false;
+        }
+        snapshotCurrent = fromSnapshot;
+        if (csvMissing)
+        {
+            out << fileName << " is missing, restoring it from " << snapshotName << "." << endl;
+        }
+        noteCsvRead();
+        return true;
+    }
+
+    // Function to fold the log into a fresh items.csv and snapshot
+    bool checkpoint(const ItemTable &items, const vector<uint32_t> &order, bool background, ostream &out) override
+    {
+        if (!cutLog(out))
+        {
+            return false;
+        }
+        string csv = encodeCsv(items, order);
+        string snapshot = encodeSnapshot(items, order);
+        snapshotCurrent = true;
+        csvMissing = false;
+        return runCheckpoint([this, csv = move(csv), snapshot = move(snapshot)]() mutable
+                             {
+            bool ok = writeFileAtomically(fileName, csv);
+            if (ok)
+            {
+                compactedStampReady = readFileStamp(fileName, compactedStamp);
+                stampSnapshot(snapshot);
+                ok = writeFileAtomically(snapshotName, snapshot);
+            }
+            if (!ok)
+            {
+                cerr << "Compaction failed: unable to write " << fileName << "." << endl;
+            }
+            return ok; },
+                             background);
+    }
+
+    // Function to write the CSV file; here that is a checkpoint, which also folds in the log
+    bool exportCsv(const ItemTable &items, const vector<uint32_t> &order, ostream &out) override
+    {
+        return checkpoint(items, order, false, out);
+    }
+
+    // Function to write the items to the snapshot, stamped with the CSV it mirrors; the snapshot may run
+    // ahead of the CSV because replaying the log over it is idempotent
+    bool saveSnapshot(const ItemTable &items, const vector<uint32_t> &order, ostream &out) override
+    {
+        waitForCheckpoint();
+        string bytes = encodeSnapshot(items, order);
+        stampSnapshot(bytes);
+        if (!writeFileAtomically(snapshotName, bytes))
+        {
+            out << "Unable to write the snapshot." << endl;
+            return false;
+        }
+        snapshotCurrent = true;
+        return true;
+    }
+
+    bool snapshotStale() const override
+    {
+        return !snapshotCurrent;
+    }
+
+    bool baseMissing() const override
+    {
+        return csvMissing;
+    }
+
+    // Function to catch up with another process: nothing is read while the CSV is unchanged, rows appended
+    // to it are parsed on their own, and a rewritten file has to be loaded again
+    StoreChange poll(const RecordSink &sink, ostream &out) override
+    {
+        if (!compactorDone)
+        {
+            // our own checkpoint is rewriting the file
+            return StoreChange::None;
+        }
+        if (compactedStampReady)
+        {
+            csvStamp = compactedStamp;
+            csvBytesRead = csvStamp.size;
+            compactedStampReady = false;
+        }
+        FileStamp current;
+        if (!readFileStamp(fileName, current) || current == csvStamp)
+        {
+            return StoreChange::None;
+        }
+
+        MappedFile file(fileName);
+        string_view data = file.view();
+        bool appended = current.inode == csvStamp.inode && csvStamp.inode != 0 && data.size() >= csvBytesRead &&
+                        data.size() >= csvStamp.size && (csvBytesRead == 0 || data[csvBytesRead - 1] == '\n');
+        if (!appended)
+        {
+            return StoreChange::Rewritten;
+        }
+
+        // only whole lines are taken; an incomplete last line is picked up once its writer finishes it
+        string_view tail = data.substr(csvBytesRead);
+        size_t lastNewline = tail.rfind('\n');
+        csvStamp = current;
+        if (lastNewline == string_view::npos)
+        {
+            return StoreChange::None;
+        }
+        tail = tail.substr(0, lastNewline + 1);
+        csvBytesRead += tail.size();
+
+        ScopedTimer timer(Metric::Load);
+        timer.bytes = tail.size();
+        ParsedChunk chunk;
+        parseItemRange(tail, chunk);
+        applyParsedRows(chunk.rows, sink);
+        if (!chunk.valid)
+        {
+            out << "Error: Invalid data on line " << chunk.lines << " of the rows appended to the file." << endl;
+        }
+        if (chunk.rows.empty())
+        {
+            return StoreChange::None;
+        }
+        snapshotCurrent = false;
+        return StoreChange::Appended;
+    }
+};
+
+// Store that keeps the items in the binary snapshot format (items.csv -> items.bin) as the authoritative
+// copy, read through a mapping without any parsing; items.csv is only read to seed a missing items.bin
+class BinaryStore : public LoggedStore
+{
+private:
+    string snapshotName;
+    // the items were seeded from the CSV and items.bin has not been written since
+    bool seeded = false;
+
+    // Function to stream items.bin, or the CSV when there is no items.bin yet, then the logs
+    bool readItems(const RecordSink &sink, ostream &out, bool &fromCsv)
+    {
+        fromCsv = false;
+        MappedFile base(snapshotName);
+        SnapshotHeader header;
+        if (base.isOpen())
+        {
+            if (!readSnapshotHeader(base, header) || !streamSnapshot(base, header, sink))
+            {
+                out << "Error: " << snapshotName << " is corrupt." << endl;
+                return false;
+            }
+        }
+        else
+        {
+            MappedFile file(fileName);
+            if (file.isOpen())
+            {
+                parseCsvRows(file.view(), loadThreads, sink, out);
+                fromCsv = true;
+            }
+            else if (!filesystem::exists(logName))
+            {
+                return false;
+            }
+        }
+        replayLogs(sink, out);
+        return true;
+    }
+
+public:
+    // Constructor
+    explicit BinaryStore(const string &file)
+        : LoggedStore(file), snapshotName(filesystem::path(file).replace_extension(".bin").string()) {}
+
+    ~BinaryStore() override
+    {
+        waitForCheckpoint();
+    }
+
+    bool scan(const RecordSink &sink, ostream &out) override
+    {
+        bool fromCsv = false;
+        return readItems(sink, out, fromCsv);
+    }
+
+    bool load(const RecordSink &sink, ostream &out) override
+    {
+        return readItems(sink, out, seeded);
+    }
+
+    // Function to fold the log into a fresh items.bin
+    bool checkpoint(const ItemTable &items, const vector<uint32_t> &order, bool background, ostream &out) override
+    {
+        if (!cutLog(out))
+        {
+            return false;
+        }
+        string snapshot = encodeSnapshot(items, order);
+        seeded = false;
+        return runCheckpoint([this, snapshot = move(snapshot)]
+                             {
+            bool ok = writeFileAtomically(snapshotName, snapshot);
+            if (!ok)
+            {
+                cerr << "Compaction failed: unable to write " << snapshotName << "." << endl;
+            }
+            return ok; },
+                             background);
+    }
+
+    bool saveSnapshot(const ItemTable &items, const vector<uint32_t> &order, ostream &out) override
+    {
+        return checkpoint(items, order, false, out);
+    }
+
+    bool snapshotStale() const override
+    {
+        return seeded;
+    }
+};
+
+// Store that keeps the items in memory only and never writes a file, so the engine can be measured
+// without disk noise; it starts from a copy of what the CSV store holds, when there is anything
+class MemoryStore : public ItemStore
+{
+private:
+    bool seededFromFile = false;
+    // rows in the order they were stored; removed rows stay behind with found cleared until a checkpoint
+    vector<StoredItem> rows;
+    unordered_map<int32_t, size_t> rowOf;
+
+    void apply(const LogRecord *records, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            const LogRecord &record = records[i];
+            if (record.op == LogOp::Add)
+            {
+                if (rowOf.emplace(record.id, rows.size()).second)
+                {
+                    rows.push_back(StoredItem{record.id, record.quantity, record.date, string(record.name), true});
+                }
+                continue;
+            }
+            auto match = rowOf.find(record.id);
+            if (match == rowOf.end())
+            {
+                continue;
+            }
+            if (record.op == LogOp::Update)
+            {
+                rows[match->second].quantity = record.quantity;
+            }
+            else if (record.op == LogOp::Remove)
+            {
+                rows[match->second].found = false;
+                rowOf.erase(match);
+            }
+        }
+    }
+
+public:
+    // Constructor
+    explicit MemoryStore(const string &file)
+        : ItemStore(file) {}
+
+    bool scan(const RecordSink &sink, ostream &out) override
+    {
+        if (!seededFromFile)
+        {
+            seededFromFile = true;
+            RecordSink seed;
+            seed.reserve = [this](size_t count)
+            {
+                rows.reserve(count);
+                rowOf.reserve(count);
+            };
+            seed.apply = [this](const LogRecord *records, size_t count)
+            {
+                apply(records, count);
+            };
+            CsvStore files(fileName);
+            files.setLoadThreads(loadThreads);
+            files.scan(seed, out);
+        }
+        sink.reserve(rowOf.size());
+        vector<LogRecord> batch;
+        batch.reserve(min(rowOf.size(), sinkBatchRows));
+        for (const auto &row : rows)
+        {
+            if (!row.found)
+            {
+                continue;
+            }
+            batch.push_back(LogRecord{LogOp::Add, row.id, row.quantity, row.date, row.name});
+            if (batch.size() == sinkBatchRows)
+            {
+                sink.apply(batch.data(), batch.size());
+                batch.clear();
+            }
+        }
+        if (!batch.empty())
+        {
+            sink.apply(batch.data(), batch.size());
+        }
+        return true;
+    }
+
+    bool put(const LogRecord *records, size_t count) override
+    {
+        apply(records, count);
+        return true;
+    }
+
+    void get(const int32_t *ids, size_t count, vector<StoredItem> &found, ostream &) override
+    {
+        found.assign(count, StoredItem());
+        for (size_t i = 0; i < count; ++i)
+        {
+            auto match = rowOf.find(ids[i]);
+            if (match != rowOf.end())
+            {
+                found[i] = rows[match->second];
+            }
+        }
+    }
+
+    // Function to drop removed rows by storing the items afresh in the given order
+    bool checkpoint(const ItemTable &items, const vector<uint32_t> &order, bool, ostream &) override
+    {
+        rows.clear();
+        rowOf.clear();
+        rows.reserve(order.size());
+        rowOf.reserve(order.size());
+        for (uint32_t slot : order)
+        {
+            rowOf.emplace(items.id(slot), rows.size());
+            rows.push_back(StoredItem{items.id(slot), items.quantity(slot), items.date(slot), string(items.name(slot)), true});
+        }
+        return true;
+    }
+};
+
+// Storage backends selectable at start-up
+enum class StoreKind
+{
+    Csv,    // items.csv plus a snapshot mirror, the default
+    Binary, // items.bin as the authoritative copy
+    Memory  // nothing written, for benchmarks
+};
+
+// Function to read a backend name; false when it is not one
+bool parseStoreKind(string_view name, StoreKind &kind)
+{
+    if (name == "csv")
+    {
+        kind = StoreKind::Csv;
+    }
+    else if (name == "binary")
+    {
+        kind = StoreKind::Binary;
+    }
+    else if (name == "memory")
+    {
+        kind = StoreKind::Memory;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+const char *storeKindName(StoreKind kind)
+{
+    return kind == StoreKind::Csv ? "csv" : kind == StoreKind::Binary ? "binary" : "memory";
+}
+
+// Function to create the store of a kind for an items file
+unique_ptr<ItemStore> makeStore(StoreKind kind, const string &file)
+{
+    if (kind == StoreKind::Binary)
+    {
+        return make_unique<BinaryStore>(file);
+    }
+    if (kind == StoreKind::Memory)
+    {
+        return make_unique<MemoryStore>(file);
+    }
+    return make_unique<CsvStore>(file);
+}
+
+// How listed items are printed
+enum class OutputFormat
+{
+    Plain,   // the classic "Item ID:..." lines
+    Aligned, // a table with padded columns
+    Csv,     // the items.csv row format
+    Json     // one JSON object per line, the format itemimport reads
+};
+
+// Renders item rows straight into a reusable buffer and hands it to the stream in large chunks,
+// with no per-row streams or flushes
+class RowWriter
+{
+private:
+    static constexpr size_t chunkSize = 64 * 1024;
+    ostream &out;
+    OutputFormat format;
+    bool streaming;
+    string buffer;
+    size_t idWidth = 0;
+    size_t nameWidth = 0;
+
+    void appendNumber(int value, size_t width = 0)
+    {
+        char digits[16];
+        size_t length = static_cast<size_t>(to_chars(digits, digits + sizeof(digits), value).ptr - digits);
+        if (length < width)
+        {
+            buffer.append(width - length, ' ');
+        }
+        buffer.append(digits, length);
+    }
+
+    void appendDate(int32_t day)
+    {
+        buffer.append(10, ' ');
+        formatDate(day, &buffer[buffer.size() - 10]);
+    }
+
+    void appendJsonString(string_view text)
+    {
+        buffer += '"';
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                buffer += '\\';
+                buffer += c;
+            }
+            else if (c == '\t')
+            {
+                buffer += "\\t";
+            }
+            else
+            {
+                buffer += c;
+            }
+        }
+        buffer += '"';
+    }
+
+    // Function to pass a full chunk on; in streaming mode it is flushed so output appears while the rest renders
+    void spill()
+    {
+        if (streaming && buffer.size() >= chunkSize)
+        {
+            out.write(buffer.data(), static_cast<streamsize>(buffer.size()));
+            out.flush();
+            buffer.clear();
+        }
+    }
+
+public:
+    // Constructor
+    RowWriter(ostream &target, OutputFormat rowFormat, bool stream)
+        : out(target), format(rowFormat), streaming(stream)
+    {
+        buffer.reserve(chunkSize + 4096);
+    }
+
+    ~RowWriter()
+    {
+        finish();
+    }
+
+    RowWriter(const RowWriter &) = delete;
+    RowWriter &operator=(const RowWriter &) = delete;
+
+    // Function to size the columns of aligned output and print its header
+    void setColumns(size_t longestId, size_t longestName)
+    {
+        if (format != OutputFormat::Aligned)
+        {
+            return;
+        }
+        idWidth = max<size_t>(longestId, 2);
+        nameWidth = max<size_t>(longestName, 4);
+        buffer.append(idWidth - 2, ' ');
+        buffer += "ID  Name";
+        buffer.append(nameWidth - 4, ' ');
+        buffer += "  Quantity  Reg Date\n";
+    }
+
+    // Function to render one item in the chosen format
+    void row(int id, string_view name, int quantity, int32_t day)
+    {
+        switch (format)
+        {
+        case OutputFormat::Plain:
+            buffer += "Item ID:";
+            appendNumber(id);
+            buffer += "\tItem Name:";
+            buffer += name;
+            buffer += "\tQuantity :";
+            appendNumber(quantity);
+            buffer += "\tReg Date :";
+            appendDate(day);
+            break;
+        case OutputFormat::Aligned:
+            appendNumber(id, idWidth);
+            buffer += "  ";
+            buffer += name;
+            buffer.append(nameWidth > name.size() ? nameWidth - name.size() : 0, ' ');
+            buffer += "  ";
+            appendNumber(quantity, 8);
+            buffer += "  ";
+            appendDate(day);
+            break;
+        case OutputFormat::Csv:
+            appendNumber(id);
+            buffer += ',';
+            buffer += name;
+            buffer += ',';
+            appendNumber(quantity);
+            buffer += ',';
+            appendDate(day);
+            break;
+        case OutputFormat::Json:
+            buffer += "{\"id\":";
+            appendNumber(id);
+            buffer += ",\"name\":";
+            appendJsonString(name);
+            buffer += ",\"quantity\":";
+            appendNumber(quantity);
+            buffer += ",\"date\":\"";
+            appendDate(day);
+            buffer += "\"}";
+            break;
+        }
+        buffer += '\n';
+        spill();
+    }
+
+    // Function to write out whatever is still buffered
+    void finish()
+    {
+        if (!buffer.empty())
+        {
+            out.write(buffer.data(), static_cast<streamsize>(buffer.size()));
+            buffer.clear();
+        }
+        out.flush();
+    }
+};
+
+// Function to print quantity totals as a table, one row per registration month when grouped
+void printQuantityStatsTable(const vector<pair<int32_t, QuantityStats>> &rows, bool byMonth, bool withThreshold,
+                             int32_t threshold, ostream &out)
+{
+    string belowHeading = "below " + to_string(threshold);
+    if (byMonth)
+    {
+        out << left << setw(10) << "month" << right;
+    }
+    out << setw(12) << "items" << setw(20) << "total quantity" << setw(12) << "min" << setw(12) << "max";
+    if (withThreshold)
+    {
+        out << setw(max<int>(14, static_cast<int>(belowHeading.size()) + 2)) << belowHeading;
+    }
+    out << "\n";
+    for (const auto &row : rows)
+    {
+        if (byMonth)
+        {
+            char month[8];
+            unsigned year = static_cast<unsigned>(row.first / 12);
+            unsigned monthOfYear = static_cast<unsigned>(row.first % 12) + 1;
+            snprintf(month, sizeof(month), "%04u-%02u", year, monthOfYear);
+            out << left << setw(10) << month << right;
+        }
+        const QuantityStats &stats = row.second;
+        out << setw(12) << stats.count << setw(20) << stats.total << setw(12) << stats.minimum << setw(12) << stats.maximum;
+        if (withThreshold)
+        {
+            out << setw(max<int>(14, static_cast<int>(belowHeading.size()) + 2)) << stats.below;
+        }
+        out << "\n";
+    }
+    out.flush();
+}
+
+// Immutable copy of the item state published for reader threads; readers share it without locking
+struct ReadView
+{
+    ItemTable items;
+    IdIndex itemIndex;
+    vector<uint32_t> nameOrder; // live slots only
+    uint64_t version = 0;
+
+    // Function to look an item up by ID; false when it does not exist in this view
+    bool find(int32_t id, Item &item) const
+    {
+        size_t slot = itemIndex.find(id);
+        if (slot == IdIndex::npos)
+        {
+            return false;
+        }
+        item = items.item(slot);
+        return true;
+    }
+};
+
+// Progress of a background load, as the status command reports it
+struct LoadProgress
+{
+    bool loading = false;
+    bool found = false;   // a finished load found items to load
+    size_t rows = 0;      // records applied so far
+    size_t expected = 0;  // base rows announced by the store; 0 while its files are still being read
+    size_t queued = 0;    // adds waiting for the load
+    double seconds = 0;   // time taken so far, or in all once finished
+};
+
+// Function to print the progress of a background load for the status command
+void printLoadStatus(const LoadProgress &progress, ostream &out)
+{
+    streamsize precision = out.precision();
+    out << fixed << setprecision(2);
+    if (!progress.loading)
+    {
+        out << (progress.found ? "All items are loaded" : "No stored items were found") << " (took " << progress.seconds << " s)." << endl;
+    }
+    else if (progress.expected == 0)
+    {
+        out << "Loading: reading the stored files, " << progress.seconds << " s so far." << endl;
+    }
+    else
+    {
+        // the count includes logged changes, so it can pass the number of stored rows
+        size_t percent = min<size_t>(99, progress.rows * 100 / progress.expected);
+        out << "Loading: " << progress.rows << " of about " << progress.expected << " items (" << percent << "%), "
+            << progress.seconds << " s so far." << endl;
+    }
+    out << defaultfloat << setprecision(static_cast<int>(precision));
+    if (progress.queued != 0)
+    {
+        out << progress.queued << " added item(s) are waiting for the load to finish." << endl;
+    }
+}
+
+// Inventory class representing the inventory system
+class Inventory
+{
+private:
+    ItemTable items;
+    // ID -> slot in items, kept in step with items so duplicate checks never touch the file
+    IdIndex itemIndex;
+    // slots in ascending name order (ties in insertion order), maintained on add so listing never sorts
+    vector<uint32_t> nameOrder;
+    // removed slots still sitting in nameOrder; they are purged in one pass before the order is next read
+    size_t removedInOrder = 0;
+    // ordered indexes for range queries, built on first use and kept up to date afterwards
+    SecondaryIndex quantityIndex{&ItemTable::quantity};
+    SecondaryIndex dateIndex{&ItemTable::date};
+    // where the items are kept between runs; every change is handed to it as a batch of log records
+    unique_ptr<ItemStore> store;
+    // how listings are printed; streamed output is handed on in chunks while the list is still rendering
+    OutputFormat outputFormat = OutputFormat::Plain;
+    bool streamOutput = true;
+    // serialises every change; readers in concurrent mode use the published view instead
+    recursive_mutex writeMutex;
+    uint64_t changeVersion = 0;
+    // concurrent read mode: a publisher thread copies the state into a fresh ReadView after changes,
+    // at most once per publishInterval; retired views are freed when their last reader drops them
+    shared_ptr<const ReadView> publishedView;
+    atomic<uint64_t> publishedVersion{0};
+    thread publisher;
+    condition_variable_any publishWake;
+    bool stopPublisher = false;
+    chrono::milliseconds publishInterval{0};
+    // background load: commands that need the items wait on loadDone, adds made meanwhile are queued and
+    // saved once the load is done, and the load's messages are kept for the session to print
+    thread loader;
+    atomic<bool> loading{false};
+    condition_variable_any loadDone;
+    atomic<size_t> loadRows{0};
+    atomic<size_t> loadExpected{0};
+    chrono::steady_clock::time_point loadStarted;
+    atomic<int64_t> loadNanos{0};
+    atomic<size_t> queuedCount{0};
+    atomic<bool> loadFound{false};
+    bool loadReported = true;
+    string loadMessages;
+    vector<ParsedRow> queuedAdds;
+    deque<string> queuedNames;
+    unordered_set<int32_t> queuedIds;
+
+    // Function to record that the state changed and wake the publisher (write lock held)
+    void changed()
+    {
+        changeVersion += 1;
+        if (publisher.joinable())
+        {
+            publishWake.notify_one();
+        }
+    }
+
+    // Function to copy the current state into a new read view and publish it (write lock held)
+    void publishLocked()
+    {
+        purgeNameOrder();
+        auto view = make_shared<ReadView>();
+        view->items = items;
+        view->itemIndex = itemIndex;
+        view->nameOrder = nameOrder;
+        view->version = changeVersion;
+        atomic_store(&publishedView, shared_ptr<const ReadView>(move(view)));
+        publishedVersion.store(changeVersion, memory_order_release);
+    }
+
+    // Function run by the publisher thread
+    void publishLoop()
+    {
+        unique_lock<recursive_mutex> lock(writeMutex);
+        while (true)
+        {
+            publishWake.wait(lock, [this]
+                             { return stopPublisher || publishedVersion.load(memory_order_relaxed) != changeVersion; });
+            if (stopPublisher)
+            {
+                return;
+            }
+            // let writers group more changes into this publication
+            lock.unlock();
+            this_thread::sleep_for(publishInterval);
+            lock.lock();
+            publishLocked();
+        }
+    }
+
+    // Function to order two slots by name, falling back to insertion order
+    bool nameBefore(uint32_t a, uint32_t b) const
+    {
+        int compared = items.name(a).compare(items.name(b));
+        return compared < 0 || (compared == 0 && a < b);
+    }
+
+    // Function to sort slots into name order by packing 4 name bytes (big-endian, zero-padded past the end,
+    // so they order like string comparison) with the slot into one integer and sorting those, then refining
+    // runs that share the bytes; small runs and runs whose names all end within the 4 bytes fall back to
+    // nameBefore, so the result is exactly what sorting by nameBefore gives. keys needs room for one
+    // integer per slot; a run reuses the part of it that lines up with the run.
+    void sortByName(uint32_t *first, uint32_t *last, uint64_t *keys, size_t depth) const
+    {
+        // depth value that asks for the exact comparison straight away
+        const size_t nameLimit = static_cast<size_t>(-1);
+        size_t count = static_cast<size_t>(last - first);
+        while (count >= 64 && depth != nameLimit)
+        {
+            bool allEqual = true;
+            bool longer = false;
+            for (size_t i = 0; i < count; ++i)
+            {
+                string_view name = items.name(first[i]);
+                uint64_t digit = 0;
+                for (size_t byte = depth; byte < depth + 4; ++byte)
+                {
+                    digit = digit << 8 | (byte < name.size() ? static_cast<unsigned char>(name[byte]) : 0u);
+                }
+                longer = longer || name.size() > depth + 4;
+                keys[i] = digit << 32 | first[i];
+                allEqual = allEqual && (keys[i] >> 32) == (keys[0] >> 32);
+            }
+            if (allEqual && longer)
+            {
+                depth += 4;
+                continue;
+            }
+            sort(keys, keys + count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                first[i] = static_cast<uint32_t>(keys[i]);
+            }
+            // refine every run of equal bytes: at the next depth while some names go on, exactly otherwise
+            for (size_t run = 0; run < count;)
+            {
+                size_t end = run + 1;
+                while (end < count && (keys[end] >> 32) == (keys[run] >> 32))
+                {
+                    ++end;
+                }
+                if (end - run > 1)
+                {
+                    sortByName(first + run, first + end, keys + run, longer ? depth + 4 : nameLimit);
+                }
+                run = end;
+            }
+            return;
+        }
+        sort(first, last, [this](uint32_t a, uint32_t b)
+             { return nameBefore(a, b); });
+    }
+
+    // Function to rebuild the name order from scratch after a bulk load
+    void rebuildNameOrder()
+    {
+        ScopedTimer timer(Metric::Sort);
+        nameOrder.clear();
+        nameOrder.reserve(items.liveCount());
+        for (size_t slot = 0; slot < items.size(); ++slot)
+        {
+            if (items.isLive(slot))
+            {
+                nameOrder.push_back(static_cast<uint32_t>(slot));
+            }
+        }
+        removedInOrder = 0;
+        // compaction writes rows in name order, so usually only the rows replayed from the log need sorting
+        auto before = [this](uint32_t a, uint32_t b)
+        { return nameBefore(a, b); };
+        auto sortedEnd = is_sorted_until(nameOrder.begin(), nameOrder.end(), before);
+        vector<uint64_t> keys(static_cast<size_t>(nameOrder.end() - sortedEnd));
+        sortByName(nameOrder.data() + (sortedEnd - nameOrder.begin()), nameOrder.data() + nameOrder.size(), keys.data(), 0);
+        inplace_merge(nameOrder.begin(), sortedEnd, nameOrder.end(), before);
+    }
+
+    // Function to drop removed slots from the name order, so each removal costs O(1) amortised
+    void purgeNameOrder()
+    {
+        if (removedInOrder == 0)
+        {
+            return;
+        }
+        nameOrder.erase(remove_if(nameOrder.begin(), nameOrder.end(), [this](uint32_t slot)
+                                  { return !items.isLive(slot); }),
+                        nameOrder.end());
+        removedInOrder = 0;
+    }
+
+    // Function to sort the slots appended to the name order from firstNew on, then merge them into the rest
+    void mergeIntoNameOrder(size_t firstNew)
+    {
+        ScopedTimer sortTimer(Metric::Sort);
+        auto middle = nameOrder.begin() + static_cast<ptrdiff_t>(firstNew);
+        vector<uint64_t> keys(nameOrder.size() - firstNew);
+        sortByName(nameOrder.data() + firstNew, nameOrder.data() + nameOrder.size(), keys.data(), 0);
+        inplace_merge(nameOrder.begin(), middle, nameOrder.end(), [this](uint32_t a, uint32_t b)
+                      { return nameBefore(a, b); });
+    }
+
+    // Function to catch up with changes another process made to the store's files: appended rows are
+    // merged in on their own, and rewritten files are loaded again; problems are reported to out
+    void refreshFromFile(ostream &out)
+    {
+        size_t firstNew = nameOrder.size();
+        RecordSink sink;
+        sink.reserve = [](size_t) {};
+        sink.apply = [this](const LogRecord *records, size_t count)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                // the first occurrence of an ID wins, as in a full load
+                size_t slot = items.size();
+                if (insertRow(records[i].id, records[i].name, records[i].quantity, records[i].date))
+                {
+                    nameOrder.push_back(static_cast<uint32_t>(slot));
+                }
+            }
+        };
+        StoreChange change = store->poll(sink, out);
+        if (change == StoreChange::Rewritten)
+        {
+            loadItems(out);
+        }
+        else if (nameOrder.size() > firstNew)
+        {
+            mergeIntoNameOrder(firstNew);
+            changed();
+        }
+    }
+
+    // Function to print the items at a range of positions in the name order
+    void printNameRange(size_t first, size_t last, ostream &out) const
+    {
+        printSlots(nameOrder.data() + first, nameOrder.data() + last, out);
+    }
+
+    // Function to print the rows of a run of slots in the order given
+    void printSlots(const uint32_t *first, const uint32_t *last, ostream &out) const
+    {
+        RowWriter writer(out, outputFormat, streamOutput);
+        if (outputFormat == OutputFormat::Aligned)
+        {
+            // the columns are as wide as the widest entry in the range, as the old tab alignment intended
+            size_t longestId = 0;
+            size_t longestName = 0;
+            char digits[16];
+            for (const uint32_t *slot = first; slot != last; ++slot)
+            {
+                longestId = max(longestId, static_cast<size_t>(to_chars(digits, digits + sizeof(digits), items.id(*slot)).ptr - digits));
+                longestName = max(longestName, items.name(*slot).size());
+            }
+            writer.setColumns(longestId, longestName);
+        }
+        for (const uint32_t *slot = first; slot != last; ++slot)
+        {
+            writer.row(items.id(*slot), items.name(*slot), items.quantity(*slot), items.date(*slot));
+        }
+    }
+
+    // Function to print the live rows whose key in an ordered index lies in [low, high]
+    void printIndexRange(SecondaryIndex &index, int32_t low, int32_t high, ostream &out)
+    {
+        index.build(items);
+        vector<uint32_t> slots;
+        index.query(items, low, high, slots);
+        if (slots.empty())
+        {
+            out << "No items match this query." << endl;
+            return;
+        }
+        printSlots(slots.data(), slots.data() + slots.size(), out);
+    }
+
+    // Function to add a row to the table and ID index unless the ID is taken (name order is left to the caller)
+    bool insertRow(int32_t id, string_view name, int32_t quantity, int32_t date)
+    {
+        if (!itemIndex.insert(id, items.size()))
+        {
+            return false;
+        }
+        items.push_back(id, name, quantity, date);
+        quantityIndex.insert(items, quantity, items.size() - 1, false);
+        dateIndex.insert(items, date, items.size() - 1, false);
+        return true;
+    }
+
+    // Function to change the quantity of a row and keep the quantity index in step
+    void setQuantity(size_t slot, int32_t quantity)
+    {
+        items.setQuantity(slot, quantity);
+        quantityIndex.insert(items, quantity, slot, true);
+    }
+
+    // Function to tombstone a row and drop it from the ID index; the ordered indexes skip it from now on
+    void removeRow(size_t slot)
+    {
+        itemIndex.erase(items.id(slot));
+        items.remove(slot);
+        removedInOrder += 1;
+        quantityIndex.markStale(items);
+        dateIndex.markStale(items);
+    }
+
+    // Function to apply one log record to the in-memory state; replays are idempotent
+    void applyLogRecord(const LogRecord &record)
+    {
+        if (record.op == LogOp::Add)
+        {
+            insertRow(record.id, record.name, record.quantity, record.date);
+            return;
+        }
+        size_t slot = itemIndex.find(record.id);
+        if (slot == IdIndex::npos)
+        {
+            return;
+        }
+        if (record.op == LogOp::Update)
+        {
+            setQuantity(slot, record.quantity);
+        }
+        else if (record.op == LogOp::Remove)
+        {
+            removeRow(slot);
+        }
+    }
+
+    // Function to read every item from the store into memory; a background load only holds the write lock
+    // while it applies a batch, so other commands can run in between
+    bool loadFromStore(ostream &out, bool background)
+    {
+        unique_lock<recursive_mutex> lock(writeMutex);
+        ScopedTimer timer(Metric::Load);
+        store->waitForCheckpoint();
+        flush();
+        items.clear();
+        itemIndex.clear();
+        nameOrder.clear();
+        quantityIndex.clear();
+        dateIndex.clear();
+
+        RecordSink sink = loadSink();
+        if (background)
+        {
+            lock.unlock();
+            sink.reserve = [this, reserve = move(sink.reserve)](size_t count)
+            {
+                lock_guard<recursive_mutex> batchLock(writeMutex);
+                reserve(count);
+                loadExpected += count;
+            };
+            sink.apply = [this, apply = move(sink.apply)](const LogRecord *records, size_t count)
+            {
+                lock_guard<recursive_mutex> batchLock(writeMutex);
+                apply(records, count);
+                loadRows += count;
+            };
+        }
+        bool found = store->load(sink, out);
+        if (background)
+        {
+            lock.lock();
+        }
+        if (!found)
+        {
+            out << "Unable to open the file." << endl;
+            return false;
+        }
+        rebuildNameOrder();
+        changed();
+        if (store->baseMissing())
+        {
+            // the base file is gone; rebuild it from what was loaded (compact() would wait for this very load)
+            store->checkpoint(items, nameOrder, false, out);
+        }
+        return true;
+    }
+
+    // Function to make a sink that applies a store's records to the in-memory state
+    RecordSink loadSink()
+    {
+        RecordSink sink;
+        sink.reserve = [this](size_t count)
+        {
+            items.reserve(items.size() + count);
+            itemIndex.reserve(items.size() + count);
+        };
+        sink.apply = [this](const LogRecord *records, size_t count)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                applyLogRecord(records[i]);
+            }
+        };
+        return sink;
+    }
+
+public:
+    // Constructor
+    Inventory(const string &file, StoreKind kind = StoreKind::Csv)
+        : store(makeStore(kind, file)) {}
+
+    // Constructor over a store of the caller's own
+    explicit Inventory(unique_ptr<ItemStore> itemStore)
+        : store(move(itemStore)) {}
+
+    ~Inventory()
+    {
+        if (loader.joinable())
+        {
+            loader.join();
+        }
+        if (publisher.joinable())
+        {
+            {
+                lock_guard<recursive_mutex> lock(writeMutex);
+                stopPublisher = true;
+            }
+            publishWake.notify_one();
+            publisher.join();
+        }
+        store->waitForCheckpoint();
+    }
+
+    // Function to start publishing read views for lock-free readers, at most once per interval
+    void enableConcurrentReads(chrono::milliseconds interval)
+    {
+        awaitLoad();
+        lock_guard<recursive_mutex> lock(writeMutex);
+        publishInterval = interval;
+        publishLocked();
+        if (!publisher.joinable())
+        {
+            publisher = thread(&Inventory::publishLoop, this);
+        }
+    }
+
+    // Function to fetch the latest published view (enableConcurrentReads() must have been called);
+    // reader threads normally go through a ViewReader, which only reloads this after a publication
+    shared_ptr<const ReadView> readView() const
+    {
+        return atomic_load(&publishedView);
+    }
+
+    // Function to return the version of the latest published view
+    uint64_t readVersion() const
+    {
+        return publishedVersion.load(memory_order_acquire);
+    }
+
+    Inventory(const Inventory &) = delete;
+    Inventory &operator=(const Inventory &) = delete;
+
+    // Function to set the log size that triggers a background compaction
+    void setCompactThreshold(size_t bytes)
+    {
+        lock_guard<recursive_mutex> lock(writeMutex);
+        store->setCompactThreshold(bytes);
+    }
+
+    // Function to wait for a running compaction to finish
+    void waitForCompaction()
+    {
+        store->waitForCheckpoint();
+    }
+
+    // Function to fold the changes into fresh store files; with a log, the log is cut over first so new
+    // changes keep flowing into a new log while the old one is compacted
+    bool compact(bool background, ostream &out = cout)
+    {
+        awaitLoad();
+        lock_guard<recursive_mutex> lock(writeMutex);
+        store->waitForCheckpoint();
+        purgeNameOrder();
+        return store->checkpoint(items, nameOrder, background, out);
+    }
+
+    // Function to start a background compaction when the log has grown past the threshold
+    void compactIfDue()
+    {
+        if (store->checkpointDue())
+        {
+            compact(true);
+        }
+    }
+
+    // Function to batch appended rows by size and age (0 bytes writes every row straight away)
+    void setWriteBatching(size_t bytes, chrono::milliseconds interval)
+    {
+        lock_guard<recursive_mutex> lock(writeMutex);
+        store->setBatching(bytes, interval);
+    }
+
+    // Function to choose how listings are printed and whether they stream out while being rendered
+    void setOutputFormat(OutputFormat format, bool stream)
+    {
+        lock_guard<recursive_mutex> lock(writeMutex);
+        outputFormat = format;
+        streamOutput = stream;
+    }
+
+    // Function to choose how far each written batch is pushed towards the disk
+    void setDurability(Durability level)
+    {
+        lock_guard<recursive_mutex> lock(writeMutex);
+        store->setDurability(level);
+    }
+
+    // Function to write out any batched rows (nothing is written while a background load runs)
+    bool flush(ostream &out = cout)
+    {
+        lock_guard<recursive_mutex> lock(writeMutex);
+        if (loading)
+        {
+            return true;
+        }
+        if (!store->flush())
+        {
+            out << "Unable to write the file." << endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Function to write out a batch whose time threshold has passed
+    void flushIfDue()
+    {
+        lock_guard<recursive_mutex> lock(writeMutex);
+        if (!loading && !store->flushIfDue())
+        {
+            cout << "Unable to write the file." << endl;
+        }
+    }
+
+    // Function to set how many threads loadItems() may use (0 means one per core)
+    void setLoadThreads(unsigned threads)
+    {
+        if (threads == 0)
+        {
+            threads = max(1u, thread::hardware_concurrency());
+        }
+        lock_guard<recursive_mutex> lock(writeMutex);
+        store->setLoadThreads(threads);
+    }
+
+    // Function to write a snapshot of the current items so the next start can skip parsing
+    bool saveSnapshot(ostream &out = cout)
+    {
+        awaitLoad();
+        lock_guard<recursive_mutex> lock(writeMutex);
+        store->waitForCheckpoint();
+        purgeNameOrder();
+        return store->saveSnapshot(items, nameOrder, out);
+    }
+
+    // Function to refresh the snapshot on the way out when the store has one to refresh
+    void saveSnapshotIfStale()
+    {
+        awaitLoad();
+        if (store->snapshotStale())
+        {
+            saveSnapshot();
+        }
+    }
+
+    // Function to write the CSV file from the items currently in memory
+    bool exportCsv(ostream &out = cout)
+    {
+        awaitLoad();
+        lock_guard<recursive_mutex> lock(writeMutex);
+        store->waitForCheckpoint();
+        purgeNameOrder();
+        return store->exportCsv(items, nameOrder, out);
+    }
+
+    // Function to import a CSV or JSONL file of new items as one validated, appended batch
+    bool importItems(const string &path, ostream &out = cout)
+    {
+        awaitLoad();
+        lock_guard<recursive_mutex> lock(writeMutex);
+        ScopedTimer timer(Metric::Import);
+        ImportBatch batch(path);
+        if (!batch.file.isOpen())
+        {
+            out << "Unable to open the file." << endl;
+            return false;
+        }
+        readImportRows(batch, [this](int id)
+                       { return itemIndex.contains(id); });
+        if (!commitRows(batch.accepted, out))
+        {
+            return false;
+        }
+        reportImport(batch, out);
+        return true;
+    }
+
+    // Function to store validated rows with new IDs, logged as a single appended batch; the positions of
+    // rows that were not stored because their ID was taken since they were validated go to skipped
+    bool commitRows(const vector<ParsedRow> &rows, ostream &out = cout, vector<size_t> *skipped = nullptr)
+    {
+        awaitLoad();
+        lock_guard<recursive_mutex> lock(writeMutex);
+        if (rows.empty())
+        {
+            return true;
+        }
+        vector<LogRecord> batch;
+        batch.reserve(rows.size());
+        for (const auto &row : rows)
+        {
+            if (!validItemName(row.name))
+            {
+                out << "Error: Invalid name for item with ID " << row.id << "." << endl;
+                return false;
+            }
+            batch.push_back(LogRecord{LogOp::Add, row.id, row.quantity, row.date, row.name});
+        }
+        if (!store->put(batch.data(), batch.size()) || !store->flush())
+        {
+            out << "Unable to write the file." << endl;
+            return false;
+        }
+        // purged removals make the name order shorter than the table, so the new slots start at its end
+        size_t firstNew = nameOrder.size();
+        items.reserve(items.size() + rows.size());
+        itemIndex.reserve(items.size() + rows.size());
+        nameOrder.reserve(items.size() + rows.size());
+        for (size_t i = 0; i < rows.size(); ++i)
+        {
+            // an ID taken since the rows were validated keeps its first item, as a replay of the log would
+            size_t slot = items.size();
+            if (insertRow(rows[i].id, rows[i].name, rows[i].quantity, rows[i].date))
+            {
+                nameOrder.push_back(static_cast<uint32_t>(slot));
+            }
+            else if (skipped != nullptr)
+            {
+                skipped->push_back(i);
+            }
+        }
+        mergeIntoNameOrder(firstNew);
+        changed();
+        compactIfDue();
+        return true;
+    }
+
+    // Function to add an item to the inventory
+    void addItem(int item_id, string_view item_name, int item_quantity, int32_t item_registration_day, ostream &out = cout)
+    {
+        if (!validItemName(item_name))
+        {
+            out << "Error: Invalid name.Must not contain a comma" << endl;
+            return;
+        }
+        lock_guard<recursive_mutex> lock(writeMutex);
+        if (loading)
+        {
+            // the ID may still turn up in the rows not loaded yet, so the add waits for the load; only a
+            // second add of a queued ID can be turned down now
+            if (!queuedIds.insert(item_id).second)
+            {
+                out << "Error: Item with ID " << item_id << " already exists." << endl;
+                return;
+            }
+            queuedNames.emplace_back(item_name);
+            queuedAdds.push_back(ParsedRow{item_id, item_quantity, item_registration_day, queuedNames.back()});
+            queuedCount = queuedAdds.size();
+            out << "Item queued; it will be saved once loading finishes." << endl;
+            return;
+        }
+        ScopedTimer timer(Metric::Add);
+        // Check if the ID is already taken using the in-memory index
+        bool taken;
+        {
+            ScopedTimer checkTimer(Metric::DuplicateCheck);
+            taken = itemIndex.contains(item_id);
+        }
+        if (taken)
+        {
+            out << "Error: Item with ID " << item_id << " already exists." << endl;
+            return;
+        }
+
+        LogRecord record{LogOp::Add, item_id, item_quantity, item_registration_day, item_name};
+        if (store->put(&record, 1))
+        {
+            // add item to existing items and index its slot
+            insertRow(item_id, item_name, item_quantity, item_registration_day);
+            // a new slot is the largest, so it goes after any equal names
+            uint32_t slot = static_cast<uint32_t>(items.size() - 1);
+            {
+                ScopedTimer sortTimer(Metric::Sort);
+                nameOrder.insert(upper_bound(nameOrder.begin(), nameOrder.end(), slot, [this](uint32_t a, uint32_t b)
+                                             { return nameBefore(a, b); }),
+                                 slot);
+            }
+            changed();
+            out << "Item saved successfully!" << endl;
+            compactIfDue();
+        }
+        else
+        {
+            out << "Unable to open the file." << endl;
+        }
+    }
+
+    // Function to change the quantity of an existing item in place
+    void updateItem(int item_id, int item_quantity, ostream &out = cout)
+    {
+        awaitLoad();
+        lock_guard<recursive_mutex> lock(writeMutex);
+        size_t slot = itemIndex.find(item_id);
+        if (slot == IdIndex::npos)
+        {
+            out << "Error: Item with ID " << item_id << " does not exist." << endl;
+            return;
+        }
+        LogRecord record{LogOp::Update, item_id, item_quantity, 0, string_view()};
+        if (!store->put(&record, 1))
+        {
+            out << "Unable to open the file." << endl;
+            return;
+        }
+        setQuantity(slot, item_quantity);
+        changed();
+        out << "Item updated successfully!" << endl;
+        compactIfDue();
+    }
+
+    // Function to remove an item; its row is tombstoned now and dropped from the files at the next compaction
+    void removeItem(int item_id, ostream &out = cout)
+    {
+        awaitLoad();
+        lock_guard<recursive_mutex> lock(writeMutex);
+        size_t slot = itemIndex.find(item_id);
+        if (slot == IdIndex::npos)
+        {
+            out << "Error: Item with ID " << item_id << " does not exist." << endl;
+            return;
+        }
+        LogRecord record{LogOp::Remove, item_id, 0, 0, string_view()};
+        if (!store->put(&record, 1))
+        {
+            out << "Unable to open the file." << endl;
+            return;
+        }
+        removeRow(slot);
+        changed();
+        out << "Item removed successfully!" << endl;
+        compactIfDue();
+    }
+
+    // Function to count the items currently in the inventory
+    size_t itemCount()
+    {
+        awaitLoad();
+        lock_guard<recursive_mutex> lock(writeMutex);
+        return items.liveCount();
+    }
+
+    // Function to list items in ascending order of their name
+    void listItems(ostream &out = cout)
+    {
+        awaitLoad();
+        lock_guard<recursive_mutex> lock(writeMutex);
+        refreshFromFile(out);
+        ScopedTimer timer(Metric::List);
+        // Check if there are any items and display a message if not
+        purgeNameOrder();
+        if (nameOrder.empty())
+        {
+            out << "No items are recorded yet." << endl;
+            return;
+        }
+
+        // Walk the maintained name order
+        printNameRange(0, nameOrder.size(), out);
+    }
+
+    // Function to list one page of items in name order (pages start at 1)
+    void listItemsPage(size_t page, size_t pageSize, ostream &out = cout)
+    {
+        awaitLoad();
+        lock_guard<recursive_mutex> lock(writeMutex);
+        refreshFromFile(out);
+        ScopedTimer timer(Metric::List);
+        purgeNameOrder();
+        // pages past the end are caught before (page - 1) * pageSize could overflow
+        if (page == 0 || pageSize == 0 || page - 1 >= (nameOrder.size() + pageSize - 1) / pageSize)
+        {
+            out << "No items on this page." << endl;
+            return;
+        }
+        size_t first = (page - 1) * pageSize;
+        size_t last = first + min(pageSize, nameOrder.size() - first);
+        printNameRange(first, last, out);
+        // machine-readable listings carry rows only
+        if (outputFormat == OutputFormat::Csv || outputFormat == OutputFormat::Json)
+        {
+            return;
+        }
+        out << "Page " << page << " of " << (nameOrder.size() + pageSize - 1) / pageSize << endl;
+    }
+
+    // Function to list the items whose name starts with a prefix, seeking into the name order
+    void listItemsWithPrefix(string_view prefix, ostream &out = cout)
+    {
+        awaitLoad();
+        lock_guard<recursive_mutex> lock(writeMutex);
+        refreshFromFile(out);
+        ScopedTimer timer(Metric::List);
+        purgeNameOrder();
+        auto first = lower_bound(nameOrder.begin(), nameOrder.end(), prefix, [this](uint32_t slot, string_view text)
+                                 { return items.name(slot) < text; });
+        auto last = first;
+        while (last != nameOrder.end() && items.name(*last).substr(0, prefix.size()) == prefix)
+        {
+            ++last;
+        }
+        if (first == last)
+        {
+            out << "No items match this name prefix." << endl;
+            return;
+        }
+        printNameRange(first - nameOrder.begin(), last - nameOrder.begin(), out);
+    }
+
+    // Function to list the items with a quantity in [low, high], ordered by quantity
+    void listItemsByQuantity(int low, int high, ostream &out = cout)
+    {
+        awaitLoad();
+        lock_guard<recursive_mutex> lock(writeMutex);
+        refreshFromFile(out);
+        ScopedTimer timer(Metric::List);
+        printIndexRange(quantityIndex, low, high, out);
+    }
+
+    // Function to list the items registered between two days (inclusive), ordered by registration date
+    void listItemsRegisteredBetween(int32_t firstDay, int32_t lastDay, ostream &out = cout)
+    {
+        awaitLoad();
+        lock_guard<recursive_mutex> lock(writeMutex);
+        refreshFromFile(out);
+        ScopedTimer timer(Metric::List);
+        printIndexRange(dateIndex, firstDay, lastDay, out);
+    }
+
+    // Function to print quantity totals over the live items, or per registration month; the count of
+    // quantities under the threshold is shown when one is given
+    void printQuantityStats(bool byMonth, bool withThreshold, int32_t threshold, ostream &out = cout)
+    {
+        awaitLoad();
+        lock_guard<recursive_mutex> lock(writeMutex);
+        refreshFromFile(out);
+        ScopedTimer timer(Metric::Aggregate);
+        if (items.liveCount() == 0)
+        {
+            out << "No items are recorded yet." << endl;
+            return;
+        }
+        vector<pair<int32_t, QuantityStats>> rows;
+        quantityStats(byMonth, threshold, rows);
+        printQuantityStatsTable(rows, byMonth, withThreshold, threshold, out);
+    }
+
+    // Function to aggregate the quantities of the live items, as one row or one row per registration month
+    void quantityStats(bool byMonth, int32_t threshold, vector<pair<int32_t, QuantityStats>> &rows)
+    {
+        awaitLoad();
+        lock_guard<recursive_mutex> lock(writeMutex);
+        if (byMonth)
+        {
+            items.quantityStatsByMonth(threshold, rows);
+        }
+        else if (items.liveCount() != 0)
+        {
+            rows.emplace_back(0, items.quantityStats(threshold));
+        }
+    }
+
+    // Function to print the item with an ID
+    void findItem(int item_id, ostream &out = cout)
+    {
+        awaitLoad();
+        lock_guard<recursive_mutex> lock(writeMutex);
+        refreshFromFile(out);
+        ScopedTimer timer(Metric::List);
+        size_t slot = itemIndex.find(item_id);
+        if (slot == IdIndex::npos)
+        {
+            out << "No items match this query." << endl;
+            return;
+        }
+        uint32_t found = static_cast<uint32_t>(slot);
+        printSlots(&found, &found + 1, out);
+    }
+
+    // Function to take the write lock for a caller that reads the table and name order directly, as a
+    // sharded inventory does to merge its shards; while it is held the name order lists live slots only
+    unique_lock<recursive_mutex> lockForReading(ostream &out)
+    {
+        awaitLoad();
+        unique_lock<recursive_mutex> lock(writeMutex);
+        refreshFromFile(out);
+        purgeNameOrder();
+        return lock;
+    }
+
+    // Function to expose the table (the write lock must be held)
+    const ItemTable &table() const
+    {
+        return items;
+    }
+
+    // Function to expose the slots in name order (the write lock must be held)
+    const vector<uint32_t> &slotsByName() const
+    {
+        return nameOrder;
+    }
+
+    // Function to check whether an ID is stored
+    bool contains(int item_id)
+    {
+        awaitLoad();
+        lock_guard<recursive_mutex> lock(writeMutex);
+        return itemIndex.contains(item_id);
+    }
+
+    // Function to collect the slots whose quantity, or registration day, lies in [low, high], in key order
+    void collectRange(bool byDate, int32_t low, int32_t high, vector<uint32_t> &slots)
+    {
+        awaitLoad();
+        lock_guard<recursive_mutex> lock(writeMutex);
+        SecondaryIndex &index = byDate ? dateIndex : quantityIndex;
+        index.build(items);
+        index.query(items, low, high, slots);
+    }
+
+    // Function to load items from the store; false when there is nothing to load from
+    bool loadItems(ostream &out = cout)
+    {
+        awaitLoad();
+        return loadFromStore(out, false);
+    }
+
+    // Function to wait for a background load to finish; it must not be called with the write lock held
+    void awaitLoad()
+    {
+        if (!loading)
+        {
+            return;
+        }
+        unique_lock<recursive_mutex> lock(writeMutex);
+        loadDone.wait(lock, [this]
+                      { return !loading; });
+    }
+
+    // Function to start loading the items on a background thread and return straight away; commands
+    // that need the items wait for the load, and adds made meanwhile are queued until it is done
+    void startLoading()
+    {
+        awaitLoad();
+        lock_guard<recursive_mutex> lock(writeMutex);
+        if (loader.joinable())
+        {
+            loader.join();
+        }
+        loading = true;
+        loadReported = false;
+        loadRows = 0;
+        loadExpected = 0;
+        loadNanos = 0;
+        loadStarted = chrono::steady_clock::now();
+        loader = thread([this]
+                        {
+            ostringstream messages;
+            bool found = loadFromStore(messages, true);
+            lock_guard<recursive_mutex> loadedLock(writeMutex);
+            loadFound = found;
+            loadNanos = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - loadStarted).count();
+            loading = false;
+            for (const auto &row : queuedAdds)
+            {
+                addItem(row.id, row.name, row.quantity, row.date, messages);
+            }
+            queuedAdds.clear();
+            queuedNames.clear();
+            queuedIds.clear();
+            queuedCount = 0;
+            loadMessages = messages.str();
+            loadDone.notify_all(); });
+    }
+
+    // Function to report how far a background load has got, without waiting for the loader's lock
+    LoadProgress loadProgress() const
+    {
+        LoadProgress progress;
+        progress.loading = loading;
+        progress.found = loadFound;
+        progress.rows = loadRows;
+        progress.expected = loadExpected;
+        progress.queued = queuedCount;
+        progress.seconds = loading ? chrono::duration<double>(chrono::steady_clock::now() - loadStarted).count() : loadNanos / 1e9;
+        return progress;
+    }
+
+    // Function to hand over the messages of a finished background load, once; false while it runs or
+    // once they were taken
+    bool takeLoadReport(string &messages, bool &found)
+    {
+        lock_guard<recursive_mutex> lock(writeMutex);
+        if (loading || loadReported)
+        {
+            return false;
+        }
+        loadReported = true;
+        messages = move(loadMessages);
+        loadMessages.clear();
+        found = loadFound;
+        return true;
+    }
+
+    // Function to reach the store directly, e.g. to measure it without the engine in front of it
+    ItemStore &storage()
+    {
+        return *store;
+    }
+};
+
+// Per-thread handle on an Inventory's published views: the common path is one atomic load of the
+// published version, and the shared view is only re-fetched after a new publication
+class ViewReader
+{
+private:
+    const Inventory &inventory;
+    shared_ptr<const ReadView> view;
+    uint64_t seen = static_cast<uint64_t>(-1);
+
+public:
+    explicit ViewReader(const Inventory &source)
+        : inventory(source) {}
+
+    const ReadView &current()
+    {
+        uint64_t version = inventory.readVersion();
+        if (version != seen || !view)
+        {
+            view = inventory.readView();
+            seen = view->version;
+        }
+        return *view;
+    }
+};
+
+// Stream buffer that discards everything, used to silence per-command messages in benchmarks
+class NullBuffer : public streambuf
+{
+protected:
+    int overflow(int c) override
+    {
+        return c;
+    }
+
+    streamsize xsputn(const char *, streamsize count) override
+    {
+        return count;
+    }
+};
+
+// Function to name the files of one shard: items.csv -> items.<part>.csv
+string shardFileName(const string &file, size_t part)
+{
+    filesystem::path name(file);
+    name.replace_extension("." + to_string(part) + filesystem::path(file).extension().string());
+    return name.string();
+}
+
+// Inventory split by ID hash over several files (items.csv -> items.0.csv, items.1.csv, ...). Each shard is a
+// complete Inventory with its own index, log and append handle, so adds to different shards run concurrently
+// and the shards load in parallel; listings merge the shards' orders
+class ShardedInventory
+{
+private:
+    string fileName;
+    // items.csv -> items.shards, recording the shard count the items were split with
+    string layoutName;
+    StoreKind storeKind;
+    vector<unique_ptr<Inventory>> shards;
+    OutputFormat outputFormat = OutputFormat::Plain;
+    bool streamOutput = true;
+
+    // Function to pick the shard of an ID; Fibonacci hashing spreads runs of consecutive IDs over all shards
+    size_t shardOf(int item_id) const
+    {
+        return static_cast<size_t>((static_cast<uint32_t>(item_id) * 0x9E3779B97F4A7C15ull) >> 32) % shards.size();
+    }
+
+    Inventory &shard(int item_id)
+    {
+        return *shards[shardOf(item_id)];
+    }
+
+    // Function to lock every shard, always in the same order, so a listing sees one consistent state
+    vector<unique_lock<recursive_mutex>> lockAll(ostream &out)
+    {
+        vector<unique_lock<recursive_mutex>> locks;
+        locks.reserve(shards.size());
+        for (auto &part : shards)
+        {
+            locks.push_back(part->lockForReading(out));
+        }
+        return locks;
+    }
+
+    // Function to order two rows of (possibly different) shards by name, then by shard
+    bool nameBefore(uint32_t shardA, uint32_t slotA, uint32_t shardB, uint32_t slotB) const
+    {
+        string_view a = shards[shardA]->table().name(slotA);
+        string_view b = shards[shardB]->table().name(slotB);
+        return a != b ? a < b : shardA < shardB;
+    }
+
+    // Function to k-way merge per-shard runs of slots, each already ordered by `before`, into (shard, slot)
+    // pairs; the first `skip` merged rows are passed over and at most `limit` are kept
+    template <typename Before>
+    vector<pair<uint32_t, uint32_t>> mergeRuns(vector<pair<const uint32_t *, const uint32_t *>> runs, size_t skip, size_t limit,
+                                               Before before) const
+    {
+        // the shard whose next slot comes first sits on top of the heap
+        auto after = [&runs, &before](uint32_t a, uint32_t b)
+        { return before(b, *runs[b].first, a, *runs[a].first); };
+        priority_queue<uint32_t, vector<uint32_t>, decltype(after)> heads(after);
+        for (uint32_t part = 0; part < runs.size(); ++part)
+        {
+            if (runs[part].first != runs[part].second)
+            {
+                heads.push(part);
+            }
+        }
+        vector<pair<uint32_t, uint32_t>> merged;
+        size_t position = 0;
+        while (!heads.empty() && merged.size() < limit)
+        {
+            uint32_t part = heads.top();
+            heads.pop();
+            uint32_t slot = *runs[part].first++;
+            if (position++ >= skip)
+            {
+                merged.emplace_back(part, slot);
+            }
+            if (runs[part].first != runs[part].second)
+            {
+                heads.push(part);
+            }
+        }
+        return merged;
+    }
+
+    // Function to print merged (shard, slot) rows in the order given
+    void printRows(const vector<pair<uint32_t, uint32_t>> &rows, ostream &out) const
+    {
+        RowWriter writer(out, outputFormat, streamOutput);
+        if (outputFormat == OutputFormat::Aligned)
+        {
+            size_t longestId = 0;
+            size_t longestName = 0;
+            char digits[16];
+            for (const auto &row : rows)
+            {
+                const ItemTable &items = shards[row.first]->table();
+                longestId = max(longestId, static_cast<size_t>(to_chars(digits, digits + sizeof(digits), items.id(row.second)).ptr - digits));
+                longestName = max(longestName, items.name(row.second).size());
+            }
+            writer.setColumns(longestId, longestName);
+        }
+        for (const auto &row : rows)
+        {
+            const ItemTable &items = shards[row.first]->table();
+            writer.row(items.id(row.second), items.name(row.second), items.quantity(row.second), items.date(row.second));
+        }
+    }
+
+    // Function to collect every shard's full name order as merge runs (shard locks held); returns the row count
+    size_t nameRuns(vector<pair<const uint32_t *, const uint32_t *>> &runs) const
+    {
+        size_t total = 0;
+        for (const auto &part : shards)
+        {
+            const vector<uint32_t> &order = part->slotsByName();
+            runs.emplace_back(order.data(), order.data() + order.size());
+            total += order.size();
+        }
+        return total;
+    }
+
+    // Function to list the rows of every shard whose quantity, or registration day, lies in [low, high]
+    void printRange(bool byDate, int32_t low, int32_t high, ostream &out)
+    {
+        auto locks = lockAll(out);
+        ScopedTimer timer(Metric::List);
+        vector<vector<uint32_t>> found(shards.size());
+        vector<pair<const uint32_t *, const uint32_t *>> runs;
+        size_t total = 0;
+        for (size_t part = 0; part < shards.size(); ++part)
+        {
+            shards[part]->collectRange(byDate, low, high, found[part]);
+            runs.emplace_back(found[part].data(), found[part].data() + found[part].size());
+            total += found[part].size();
+        }
+        if (total == 0)
+        {
+            out << "No items match this query." << endl;
+            return;
+        }
+        printRows(mergeRuns(runs, 0, total, [this, byDate](uint32_t shardA, uint32_t slotA, uint32_t shardB, uint32_t slotB)
+                            {
+                                const ItemTable &a = shards[shardA]->table();
+                                const ItemTable &b = shards[shardB]->table();
+                                int32_t keyA = byDate ? a.date(slotA) : a.quantity(slotA);
+                                int32_t keyB = byDate ? b.date(slotB) : b.quantity(slotB);
+                                return keyA != keyB ? keyA < keyB : shardA < shardB; }),
+                  out);
+    }
+
+public:
+    // Constructor
+    ShardedInventory(const string &file, size_t count, StoreKind kind = StoreKind::Csv)
+        : fileName(file), layoutName(filesystem::path(file).replace_extension(".shards").string()), storeKind(kind)
+    {
+        for (size_t part = 0; part < count; ++part)
+        {
+            shards.push_back(make_unique<Inventory>(shardFileName(file, part), kind));
+        }
+    }
+
+    // Function to check that the files were split over as many shards as configured, splitting an unsharded
+    // inventory the first time; IDs are routed by hash, so another shard count would look in the wrong files
+    bool openLayout(ostream &out = cout)
+    {
+        ifstream layout(layoutName);
+        size_t recorded = 0;
+        if (layout >> recorded)
+        {
+            if (recorded != shards.size())
+            {
+                out << "Error: the items are split into " << recorded << " shards; start with --shards " << recorded << "." << endl;
+                return false;
+            }
+            return true;
+        }
+
+        // the unsharded files stay as they are; they are no longer read once the layout is recorded
+        NullBuffer discard;
+        ostream silent(&discard);
+        Inventory whole(fileName, storeKind);
+        if (whole.loadItems(silent) && whole.itemCount() != 0)
+        {
+            auto lock = whole.lockForReading(silent);
+            const ItemTable &items = whole.table();
+            vector<vector<ParsedRow>> rows(shards.size());
+            for (size_t slot = 0; slot < items.size(); ++slot)
+            {
+                if (items.isLive(slot))
+                {
+                    rows[shardOf(items.id(slot))].push_back(ParsedRow{items.id(slot), items.quantity(slot), items.date(slot), items.name(slot)});
+                }
+            }
+            for (size_t part = 0; part < shards.size(); ++part)
+            {
+                shards[part]->loadItems(silent);
+                rows[part].erase(remove_if(rows[part].begin(), rows[part].end(), [&](const ParsedRow &row)
+                                           { return shards[part]->contains(row.id); }),
+                                 rows[part].end());
+                if (!shards[part]->commitRows(rows[part], out) || !shards[part]->compact(false, out))
+                {
+                    return false;
+                }
+            }
+            out << "Split " << whole.itemCount() << " items from " << fileName << " into " << shards.size() << " shards." << endl;
+        }
+        // a memory store writes nothing, so it splits again on every start
+        if (storeKind != StoreKind::Memory && !writeFileAtomically(layoutName, to_string(shards.size()) + "\n"))
+        {
+            out << "Unable to write the file." << endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Function to load every shard, each on its own thread; false when no shard had anything to load
+    bool loadItems(ostream &out = cout)
+    {
+        vector<ostringstream> messages(shards.size());
+        vector<char> loaded(shards.size());
+        vector<thread> workers;
+        workers.reserve(shards.size());
+        for (size_t part = 0; part < shards.size(); ++part)
+        {
+            workers.emplace_back([this, part, &messages, &loaded]
+                                 { loaded[part] = shards[part]->loadItems(messages[part]); });
+        }
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+        bool any = false;
+        for (size_t part = 0; part < shards.size(); ++part)
+        {
+            if (loaded[part])
+            {
+                out << messages[part].str();
+                any = true;
+            }
+        }
+        if (!any)
+        {
+            out << "Unable to open the file." << endl;
+        }
+        return any;
+    }
+
+    // Function to wait until every shard has finished loading
+    void awaitLoad()
+    {
+        for (auto &part : shards)
+        {
+            part->awaitLoad();
+        }
+    }
+
+    // Function to start loading every shard on its own background thread
+    void startLoading()
+    {
+        for (auto &part : shards)
+        {
+            part->startLoading();
+        }
+    }
+
+    // Function to add up the load progress of the shards
+    LoadProgress loadProgress() const
+    {
+        LoadProgress total;
+        for (const auto &part : shards)
+        {
+            LoadProgress progress = part->loadProgress();
+            total.loading = total.loading || progress.loading;
+            total.found = total.found || progress.found;
+            total.rows += progress.rows;
+            total.expected += progress.expected;
+            total.queued += progress.queued;
+            total.seconds = max(total.seconds, progress.seconds);
+        }
+        return total;
+    }
+
+    // Function to hand over the messages of the shards' loads once every shard is done, as loadItems() prints them
+    bool takeLoadReport(string &messages, bool &found)
+    {
+        if (loadProgress().loading)
+        {
+            return false;
+        }
+        messages.clear();
+        found = false;
+        for (auto &part : shards)
+        {
+            string partMessages;
+            bool partFound = false;
+            if (!part->takeLoadReport(partMessages, partFound))
+            {
+                return false;
+            }
+            if (partFound)
+            {
+                messages += partMessages;
+                found = true;
+            }
+        }
+        if (!found)
+        {
+            messages += "Unable to open the file.\n";
+        }
+        return true;
+    }
+
+    // Function to count the items of all shards
+    size_t itemCount()
+    {
+        size_t total = 0;
+        for (auto &part : shards)
+        {
+            total += part->itemCount();
+        }
+        return total;
+    }
+
+    // Function to share the load threads out over the shards (0 means one per core)
+    void setLoadThreads(unsigned threads)
+    {
+        if (threads == 0)
+        {
+            threads = max(1u, thread::hardware_concurrency());
+        }
+        for (auto &part : shards)
+        {
+            part->setLoadThreads(max<unsigned>(1, threads / static_cast<unsigned>(shards.size())));
+        }
+    }
+
+    void setCompactThreshold(size_t bytes)
+    {
+        for (auto &part : shards)
+        {
+            part->setCompactThreshold(bytes);
+        }
+    }
+
+    void setWriteBatching(size_t bytes, chrono::milliseconds interval)
+    {
+        for (auto &part : shards)
+        {
+            part->setWriteBatching(bytes, interval);
+        }
+    }
+
+    void setDurability(Durability level)
+    {
+        for (auto &part : shards)
+        {
+            part->setDurability(level);
+        }
+    }
+
+    void setOutputFormat(OutputFormat format, bool stream)
+    {
+        outputFormat = format;
+        streamOutput = stream;
+        for (auto &part : shards)
+        {
+            part->setOutputFormat(format, stream);
+        }
+    }
+
+    bool flush(ostream &out = cout)
+    {
+        bool ok = true;
+        for (auto &part : shards)
+        {
+            ok = part->flush(out) && ok;
+        }
+        return ok;
+    }
+
+    void flushIfDue()
+    {
+        for (auto &part : shards)
+        {
+            part->flushIfDue();
+        }
+    }
+
+    bool compact(bool background, ostream &out = cout)
+    {
+        bool ok = true;
+        for (auto &part : shards)
+        {
+            ok = part->compact(background, out) && ok;
+        }
+        return ok;
+    }
+
+    bool exportCsv(ostream &out = cout)
+    {
+        return compact(false, out);
+    }
+
+    bool saveSnapshot(ostream &out = cout)
+    {
+        bool ok = true;
+        for (auto &part : shards)
+        {
+            ok = part->saveSnapshot(out) && ok;
+        }
+        return ok;
+    }
+
+    void saveSnapshotIfStale()
+    {
+        for (auto &part : shards)
+        {
+            part->saveSnapshotIfStale();
+        }
+    }
+
+    // Function to import a file of new items: rows are validated against every shard, then each shard writes
+    // its share as one batch, all shards at once
+    bool importItems(const string &path, ostream &out = cout)
+    {
+        ScopedTimer timer(Metric::Import);
+        ImportBatch batch(path);
+        if (!batch.file.isOpen())
+        {
+            out << "Unable to open the file." << endl;
+            return false;
+        }
+        readImportRows(batch, [this](int id)
+                       { return shard(id).contains(id); });
+        vector<vector<ParsedRow>> rows(shards.size());
+        vector<vector<size_t>> positions(shards.size());
+        for (size_t i = 0; i < batch.accepted.size(); ++i)
+        {
+            size_t part = shardOf(batch.accepted[i].id);
+            rows[part].push_back(batch.accepted[i]);
+            positions[part].push_back(i);
+        }
+        vector<ostringstream> messages(shards.size());
+        vector<char> written(shards.size());
+        vector<vector<size_t>> skipped(shards.size());
+        vector<thread> workers;
+        workers.reserve(shards.size());
+        for (size_t part = 0; part < shards.size(); ++part)
+        {
+            workers.emplace_back([this, part, &rows, &messages, &written, &skipped]
+                                 { written[part] = shards[part]->commitRows(rows[part], messages[part], &skipped[part]); });
+        }
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+
+        // rows a shard did not store are rejected, so the report counts only what was committed
+        bool ok = true;
+        vector<char> stored(batch.accepted.size(), 1);
+        for (size_t part = 0; part < shards.size(); ++part)
+        {
+            out << messages[part].str();
+            ok = ok && written[part];
+            for (size_t i = 0; i < positions[part].size() && !written[part]; ++i)
+            {
+                stored[positions[part][i]] = 0;
+                batch.rejected.emplace_back(batch.acceptedLines[positions[part][i]], "shard could not be written");
+            }
+            for (size_t i : skipped[part])
+            {
+                stored[positions[part][i]] = 0;
+                batch.rejected.emplace_back(batch.acceptedLines[positions[part][i]],
+                                            "item with ID " + to_string(rows[part][i].id) + " already exists");
+            }
+        }
+        size_t kept = 0;
+        for (size_t i = 0; i < batch.accepted.size(); ++i)
+        {
+            if (stored[i])
+            {
+                batch.accepted[kept] = batch.accepted[i];
+                batch.acceptedLines[kept++] = batch.acceptedLines[i];
+            }
+        }
+        batch.accepted.resize(kept);
+        batch.acceptedLines.resize(kept);
+        sort(batch.rejected.begin(), batch.rejected.end());
+        reportImport(batch, out);
+        return ok;
+    }
+
+    void addItem(int item_id, string_view item_name, int item_quantity, int32_t item_registration_day, ostream &out = cout)
+    {
+        shard(item_id).addItem(item_id, item_name, item_quantity, item_registration_day, out);
+    }
+
+    void updateItem(int item_id, int item_quantity, ostream &out = cout)
+    {
+        shard(item_id).updateItem(item_id, item_quantity, out);
+    }
+
+    void removeItem(int item_id, ostream &out = cout)
+    {
+        shard(item_id).removeItem(item_id, out);
+    }
+
+    void findItem(int item_id, ostream &out = cout)
+    {
+        shard(item_id).findItem(item_id, out);
+    }
+
+    // Function to list the items of all shards in alphabetical order
+    void listItems(ostream &out = cout)
+    {
+        auto locks = lockAll(out);
+        ScopedTimer timer(Metric::List);
+        vector<pair<const uint32_t *, const uint32_t *>> runs;
+        size_t total = nameRuns(runs);
+        if (total == 0)
+        {
+            out << "No items are recorded yet." << endl;
+            return;
+        }
+        printRows(mergeRuns(runs, 0, total, [this](uint32_t shardA, uint32_t slotA, uint32_t shardB, uint32_t slotB)
+                            { return nameBefore(shardA, slotA, shardB, slotB); }),
+                  out);
+    }
+
+    // Function to list one page of the merged name order (pages start at 1)
+    void listItemsPage(size_t page, size_t pageSize, ostream &out = cout)
+    {
+        auto locks = lockAll(out);
+        ScopedTimer timer(Metric::List);
+        vector<pair<const uint32_t *, const uint32_t *>> runs;
+        size_t total = nameRuns(runs);
+        if (page == 0 || pageSize == 0 || page - 1 >= (total + pageSize - 1) / pageSize)
+        {
+            out << "No items on this page." << endl;
+            return;
+        }
+        size_t first = (page - 1) * pageSize;
+        printRows(mergeRuns(runs, first, pageSize, [this](uint32_t shardA, uint32_t slotA, uint32_t shardB, uint32_t slotB)
+                            { return nameBefore(shardA, slotA, shardB, slotB); }),
+                  out);
+        // machine-readable listings carry rows only
+        if (outputFormat == OutputFormat::Csv || outputFormat == OutputFormat::Json)
+        {
+            return;
+        }
+        out << "Page " << page << " of " << (total + pageSize - 1) / pageSize << endl;
+    }
+
+    // Function to list the items of all shards whose name starts with a prefix
+    void listItemsWithPrefix(string_view prefix, ostream &out = cout)
+    {
+        auto locks = lockAll(out);
+        ScopedTimer timer(Metric::List);
+        vector<pair<const uint32_t *, const uint32_t *>> runs;
+        size_t total = 0;
+        for (const auto &part : shards)
+        {
+            const ItemTable &items = part->table();
+            const vector<uint32_t> &order = part->slotsByName();
+            auto first = lower_bound(order.begin(), order.end(), prefix, [&items](uint32_t slot, string_view text)
+                                     { return items.name(slot) < text; });
+            auto last = first;
+            while (last != order.end() && items.name(*last).substr(0, prefix.size()) == prefix)
+            {
+                ++last;
+            }
+            runs.emplace_back(order.data() + (first - order.begin()), order.data() + (last - order.begin()));
+            total += static_cast<size_t>(last - first);
+        }
+        if (total == 0)
+        {
+            out << "No items match this name prefix." << endl;
+            return;
+        }
+        printRows(mergeRuns(runs, 0, total, [this](uint32_t shardA, uint32_t slotA, uint32_t shardB, uint32_t slotB)
+                            { return nameBefore(shardA, slotA, shardB, slotB); }),
+                  out);
+    }
+
+    void listItemsByQuantity(int low, int high, ostream &out = cout)
+    {
+        printRange(false, low, high, out);
+    }
+
+    void listItemsRegisteredBetween(int32_t firstDay, int32_t lastDay, ostream &out = cout)
+    {
+        printRange(true, firstDay, lastDay, out);
+    }
+
+    // Function to print quantity totals over all shards, or per registration month
+    void printQuantityStats(bool byMonth, bool withThreshold, int32_t threshold, ostream &out = cout)
+    {
+        auto locks = lockAll(out);
+        ScopedTimer timer(Metric::Aggregate);
+        map<int32_t, QuantityStats> merged;
+        for (auto &part : shards)
+        {
+            vector<pair<int32_t, QuantityStats>> rows;
+            part->quantityStats(byMonth, threshold, rows);
+            for (const auto &row : rows)
+            {
+                merged[row.first].merge(row.second);
+            }
+        }
+        if (merged.empty())
+        {
+            out << "No items are recorded yet." << endl;
+            return;
+        }
+        printQuantityStatsTable(vector<pair<int32_t, QuantityStats>>(merged.begin(), merged.end()), byMonth, withThreshold, threshold, out);
+    }
+};
+
+// Function to measure lock-free read throughput while a writer keeps changing quantities, for 1, 2, 4...
+// reader threads; it works on a generated inventory in a scratch directory, never on items.csv
+void runStressBenchmark(size_t rows, unsigned maxReaders, double seconds)
+{
+    filesystem::path directory = filesystem::temp_directory_path() / "inventory_stress";
+    filesystem::remove_all(directory);
+    filesystem::create_directories(directory);
+    {
+        ofstream file(directory / "items.csv");
+        for (size_t i = 0; i < rows; ++i)
+        {
+            file << i << ",Item" << (i * 7919) % rows << "," << i % 1000 << ",2023-01-01\n";
+        }
+    }
+
+    NullBuffer discard;
+    streambuf *console = cout.rdbuf(&discard);
+    {
+        Inventory inventory((directory / "items.csv").string());
+        inventory.loadItems();
+        inventory.setWriteBatching(1 << 20, chrono::milliseconds(100));
+        inventory.setDurability(Durability::None);
+        inventory.enableConcurrentReads(chrono::milliseconds(10));
+
+        for (unsigned readers = 1; readers <= maxReaders; readers *= 2)
+        {
+            atomic<bool> stop{false};
+            atomic<uint64_t> reads{0};
+            atomic<uint64_t> writes{0};
+            vector<thread> threads;
+            for (unsigned r = 0; r < readers; ++r)
+            {
+                threads.emplace_back([&, r]
+                                     {
+                    ViewReader reader(inventory);
+                    uint64_t state = 0x9E3779B97F4A7C15ull * (r + 1);
+                    uint64_t done = 0;
+                    int64_t checksum = 0;
+                    while (!stop.load(memory_order_relaxed))
+                    {
+                        const ReadView &view = reader.current();
+                        for (int i = 0; i < 256; ++i)
+                        {
+                            state ^= state << 13;
+                            state ^= state >> 7;
+                            state ^= state << 17;
+                            size_t slot = view.itemIndex.find(static_cast<int32_t>(state % rows));
+                            checksum += slot == IdIndex::npos ? 0 : view.items.quantity(slot);
+                        }
+                        done += 256;
+                    }
+                    reads += done + (checksum == -1); });
+            }
+            threads.emplace_back([&]
+                                 {
+                uint64_t state = 12345;
+                while (!stop.load(memory_order_relaxed))
+                {
+                    state = state * 6364136223846793005ull + 1442695040888963407ull;
+                    inventory.updateItem(static_cast<int>((state >> 33) % rows), static_cast<int>(state % 1000));
+                    writes += 1;
+                } });
+            this_thread::sleep_for(chrono::duration<double>(seconds));
+            stop = true;
+            for (auto &worker : threads)
+            {
+                worker.join();
+            }
+            cout.rdbuf(console);
+            cout << readers << " reader(s): " << static_cast<uint64_t>(reads / seconds) << " reads/sec, "
+                 << static_cast<uint64_t>(writes / seconds) << " writes/sec" << endl;
+            cout.rdbuf(&discard);
+        }
+    }
+    cout.rdbuf(console);
+    filesystem::remove_all(directory);
+}
+
+// Function to clear the console screen
+void clearScreen()
+{
+#ifdef _WIN32
+    system("cls"); // For Windows
+#else
+    system("clear"); // For Linux and macOS
+#endif
+}
+
+// Function to display help
+void displayHelp(ostream &out = cout)
+{
+    out << "--------------------------------------\n";
+    out << "*       Commands syntaxes              *\n";
+    out << "--------------------------------------\n";
+    out << "itemadd <item_id> <item_name> <quantity> <registration_date>\n";
+    out << "itemupdate <item_id> <quantity>\n";
+    out << "itemremove <item_id>\n";
+    out << "itemslist\n";
+    out << "itemslist page <page_number> [page_size]\n";
+    out << "itemslist prefix <name_prefix>\n";
+    out << "itemsfind name=<name_prefix> | itemsfind id=<item_id>\n";
+    out << "itemsrange qty <low> <high>\n";
+    out << "itemsrange date <first_date> <last_date>\n";
+    out << "itemsbetween <first_date> <last_date>\n";
+    out << "itemsstats [below <quantity>] [by month]\n";
+    out << "itemimport <file.csv|file.jsonl>\n";
+    out << "itemsexport <snapshot|csv>\n";
+    out << "batch <bytes> [interval_ms] | batch off\n";
+    out << "durability <none|flush|fsync>\n";
+    out << "output <plain|aligned|csv|json> [stream|buffered]\n";
+    out << "flush\n";
+    out << "compact\n";
+    out << "stats [json|reset]\n";
+    out << "status\n";
+    out << "help\n";
+    out << "exit\n";
+}
+
+// Commands understood by the console and the server
+enum class Verb
+{
+    Invalid,
+    ItemAdd,
+    ItemUpdate,
+    ItemRemove,
+    ItemsList,
+    ItemsListPage,
+    ItemsListPrefix,
+    ItemsFind,
+    ItemsRangeQuantity,
+    ItemsBetween,
+    ItemsStats,
+    ItemImport,
+    ExportSnapshot,
+    ExportCsv,
+    Flush,
+    BatchOff,
+    Batch,
+    SetDurability,
+    SetOutput,
+    Compact,
+    Stats,
+    StatsJson,
+    StatsReset,
+    Status,
+    Help,
+    Clear,
+    Exit
+};
+
+// One tokenized command; text fields are views into the command line, error holds the reply for bad syntax
+struct ParsedCommand
+{
+    Verb verb = Verb::Invalid;
+    const char *error = nullptr;
+    int id = 0;
+    int quantity = 0;
+    int32_t day = 0;
+    size_t count = 0; // page number or batch bytes
+    long size = 0;    // page size or batch interval in ms
+    Durability durability = Durability::Flush;
+    OutputFormat format = OutputFormat::Plain;
+    bool stream = true;
+    int32_t low = 0;  // range bounds: quantities or registration days; itemsstats threshold
+    int32_t high = 0;
+    bool grouped = false;      // itemsstats by month
+    bool hasThreshold = false; // itemsstats below <n>
+    string_view text; // item name, name prefix, import path or durability level
+};
+
+const char *const itemAddUsage = "Invalid format. Enter data in the following format:\nitemadd <item_id> <item_name> <quantity> <registration_date>\n";
+const char *const itemUpdateUsage = "Invalid format. Enter data in the following format:\nitemupdate <item_id> <quantity>\n";
+const char *const itemRemoveUsage = "Invalid format. Enter data in the following format:\nitemremove <item_id>\n";
+const char *const pageUsage = "Invalid format. Enter data in the following format:\nitemslist page <page_number> [page_size]\n";
+const char *const batchUsage = "Invalid format. Enter data in the following format:\nbatch <bytes> [interval_ms] | batch off\n";
+const char *const durabilityUsage = "Invalid format. Enter data in the following format:\ndurability <none|flush|fsync>\n";
+const char *const outputUsage = "Invalid format. Enter data in the following format:\noutput <plain|aligned|csv|json> [stream|buffered]\n";
+const char *const findUsage = "Invalid format. Enter data in the following format:\nitemsfind name=<name_prefix> | itemsfind id=<item_id>\n";
+const char *const rangeUsage = "Invalid format. Enter data in the following format:\nitemsrange qty <low> <high> | itemsrange date <first_date> <last_date>\n";
+const char *const betweenUsage = "Invalid format. Enter data in the following format:\nitemsbetween <first_date> <last_date>\n";
+const char *const statsUsage = "Invalid format. Enter data in the following format:\nitemsstats [below <quantity>] [by month]\n";
+const char *const invalidCommand = "Invalid command. Please try again.\n";
+
+// Function to compare a token with a lowercase keyword, ignoring the token's case
+bool equalsIgnoreCase(string_view token, string_view keyword)
+{
+    if (token.size() != keyword.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < token.size(); ++i)
+    {
+        char c = token[i];
+        if ((c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c) != keyword[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Function to drop leading spaces and tabs
+string_view trimLeft(string_view text)
+{
+    size_t first = 0;
+    while (first < text.size() && (text[first] == ' ' || text[first] == '\t'))
+    {
+        first += 1;
+    }
+    return text.substr(first);
+}
+
+// Function to take the next space-separated token off the front of rest
+string_view nextToken(string_view &rest)
+{
+    rest = trimLeft(rest);
+    size_t end = 0;
+    while (end < rest.size() && rest[end] != ' ' && rest[end] != '\t')
+    {
+        end += 1;
+    }
+    string_view token = rest.substr(0, end);
+    rest.remove_prefix(end);
+    return token;
+}
+
+// Function to tokenize a command line once and parse its arguments; it never allocates or throws
+ParsedCommand parseCommand(string_view line)
+{
+    ParsedCommand command;
+    while (!line.empty() && (line.back() == ' ' || line.back() == '\t' || line.back() == '\r'))
+    {
+        line.remove_suffix(1);
+    }
+    string_view rest = line;
+    string_view verb = nextToken(rest);
+    string_view afterVerb = trimLeft(rest);
+    string_view first = nextToken(rest);
+    string_view afterFirst = trimLeft(rest);
+    string_view second = nextToken(rest);
+
+    if (equalsIgnoreCase(verb, "itemadd"))
+    {
+        // itemadd <id> <name> <quantity> <date>
+        string_view quantity = nextToken(rest);
+        string_view date = nextToken(rest);
+        command.verb = Verb::ItemAdd;
+        command.text = second;
+        if (first.empty() || command.text.empty() || quantity.empty() || date.empty() || !trimLeft(rest).empty())
+        {
+            command.error = itemAddUsage;
+        }
+        else if (!parseIntField(first, command.id))
+        {
+            command.error = "Error: Invalid ID.Must be a valid integer\n";
+        }
+        else if (command.id < 0)
+        {
+            command.error = "Error: Invalid ID.Must be a positive integer\n";
+        }
+        else if (!parseIntField(quantity, command.quantity))
+        {
+            command.error = "Error: Invalid quantity.Must be a valid integer.\n";
+        }
+        else if (command.quantity < 0)
+        {
+            command.error = "Error: Invalid quantity.Must be a positive integer\n";
+        }
+        else if (!validItemName(command.text))
+        {
+            command.error = "Error: Invalid name.Must not contain a comma\n";
+        }
+        else if (!parseDate(date, command.day))
+        {
+            command.error = "Invalid date format. Please enter the date in the format YYYY-MM-DD.\n";
+        }
+    }
+    else if (equalsIgnoreCase(verb, "itemupdate"))
+    {
+        command.verb = Verb::ItemUpdate;
+        if (!parseIntField(first, command.id) || !parseIntField(second, command.quantity) || !trimLeft(rest).empty())
+        {
+            command.error = itemUpdateUsage;
+        }
+        else if (command.quantity < 0)
+        {
+            command.error = "Error: Invalid quantity.Must be a positive integer\n";
+        }
+    }
+    else if (equalsIgnoreCase(verb, "itemremove"))
+    {
+        command.verb = Verb::ItemRemove;
+        if (!parseIntField(first, command.id) || !second.empty())
+        {
+            command.error = itemRemoveUsage;
+        }
+    }
+    else if (equalsIgnoreCase(verb, "itemslist"))
+    {
+        if (first.empty())
+        {
+            command.verb = Verb::ItemsList;
+        }
+        else if (equalsIgnoreCase(first, "page"))
+        {
+            // itemslist page <page_number> [page_size]
+            command.verb = Verb::ItemsListPage;
+            command.size = 20;
+            if (!parseIntField(second, command.count) || (!rest.empty() && !parseIntField(trimLeft(rest), command.size)) || command.size < 0 ||
+                (command.count != 0 && command.size != 0 && command.count - 1 > numeric_limits<size_t>::max() / static_cast<size_t>(command.size)))
+            {
+                command.error = pageUsage;
+            }
+        }
+        else if (equalsIgnoreCase(first, "prefix") && !second.empty())
+        {
+            command.verb = Verb::ItemsListPrefix;
+            command.text = afterFirst;
+        }
+        else
+        {
+            command.error = invalidCommand;
+        }
+    }
+    else if (equalsIgnoreCase(verb, "itemsfind"))
+    {
+        // itemsfind name=<prefix> | itemsfind id=<id>
+        size_t equals = afterVerb.find('=');
+        string_view field = afterVerb.substr(0, equals == string_view::npos ? 0 : equals);
+        string_view value = equals == string_view::npos ? string_view() : afterVerb.substr(equals + 1);
+        command.verb = Verb::ItemsFind;
+        if (equalsIgnoreCase(field, "name") && !value.empty())
+        {
+            command.verb = Verb::ItemsListPrefix;
+            command.text = value;
+        }
+        else if (!equalsIgnoreCase(field, "id") || !parseIntField(value, command.id))
+        {
+            command.error = findUsage;
+        }
+    }
+    else if (equalsIgnoreCase(verb, "itemsrange"))
+    {
+        // itemsrange qty <low> <high> | itemsrange date <first_date> <last_date>
+        string_view high = nextToken(rest);
+        bool byDate = equalsIgnoreCase(first, "date");
+        command.verb = byDate ? Verb::ItemsBetween : Verb::ItemsRangeQuantity;
+        bool valid = byDate ? parseDate(second, command.low) && parseDate(high, command.high)
+                            : equalsIgnoreCase(first, "qty") && parseIntField(second, command.low) && parseIntField(high, command.high);
+        if (!valid || !trimLeft(rest).empty())
+        {
+            command.error = rangeUsage;
+        }
+    }
+    else if (equalsIgnoreCase(verb, "itemsbetween"))
+    {
+        command.verb = Verb::ItemsBetween;
+        if (!parseDate(first, command.low) || !parseDate(second, command.high) || !trimLeft(rest).empty())
+        {
+            command.error = betweenUsage;
+        }
+    }
+    else if (equalsIgnoreCase(verb, "itemsstats"))
+    {
+        // itemsstats [below <quantity>] [by month]
+        command.verb = Verb::ItemsStats;
+        string_view options = afterVerb;
+        string_view option = nextToken(options);
+        if (equalsIgnoreCase(option, "below"))
+        {
+            command.hasThreshold = parseIntField(nextToken(options), command.low);
+            option = command.hasThreshold ? nextToken(options) : string_view("below");
+        }
+        if (equalsIgnoreCase(option, "by"))
+        {
+            command.grouped = equalsIgnoreCase(nextToken(options), "month");
+            option = command.grouped ? nextToken(options) : string_view("by");
+        }
+        if (!option.empty() || !trimLeft(options).empty())
+        {
+            command.error = statsUsage;
+        }
+    }
+    else if (equalsIgnoreCase(verb, "itemimport") && !first.empty())
+    {
+        command.verb = Verb::ItemImport;
+        command.text = afterVerb;
+    }
+    else if (equalsIgnoreCase(verb, "itemsexport") && second.empty() && (equalsIgnoreCase(first, "snapshot") || equalsIgnoreCase(first, "csv")))
+    {
+        command.verb = equalsIgnoreCase(first, "csv") ? Verb::ExportCsv : Verb::ExportSnapshot;
+    }
+    else if (equalsIgnoreCase(verb, "batch") && !first.empty())
+    {
+        command.verb = equalsIgnoreCase(first, "off") && second.empty() ? Verb::BatchOff : Verb::Batch;
+        command.size = 1000;
+        if (command.verb == Verb::Batch &&
+            (!parseIntField(first, command.count) || (!second.empty() && !parseIntField(second, command.size)) || command.size < 0 ||
+             !trimLeft(rest).empty()))
+        {
+            command.error = batchUsage;
+        }
+    }
+    else if (equalsIgnoreCase(verb, "durability") && !first.empty())
+    {
+        command.verb = Verb::SetDurability;
+        command.text = first;
+        if (equalsIgnoreCase(first, "none") && second.empty())
+        {
+            command.durability = Durability::None;
+        }
+        else if (equalsIgnoreCase(first, "flush") && second.empty())
+        {
+            command.durability = Durability::Flush;
+        }
+        else if (equalsIgnoreCase(first, "fsync") && second.empty())
+        {
+            command.durability = Durability::Fsync;
+        }
+        else
+        {
+            command.error = durabilityUsage;
+        }
+    }
+    else if (equalsIgnoreCase(verb, "output") && !first.empty())
+    {
+        // output <plain|aligned|csv|json> [stream|buffered]
+        command.verb = Verb::SetOutput;
+        command.text = first;
+        command.stream = !equalsIgnoreCase(second, "buffered");
+        bool formatKnown = true;
+        if (equalsIgnoreCase(first, "plain"))
+        {
+            command.format = OutputFormat::Plain;
+        }
+        else if (equalsIgnoreCase(first, "aligned"))
+        {
+            command.format = OutputFormat::Aligned;
+        }
+        else if (equalsIgnoreCase(first, "csv"))
+        {
+            command.format = OutputFormat::Csv;
+        }
+        else if (equalsIgnoreCase(first, "json"))
+        {
+            command.format = OutputFormat::Json;
+        }
+        else
+        {
+            formatKnown = false;
+        }
+        if (!formatKnown || !(second.empty() || equalsIgnoreCase(second, "stream") || equalsIgnoreCase(second, "buffered")) || !trimLeft(rest).empty())
+        {
+            command.error = outputUsage;
+        }
+    }
+    else if (equalsIgnoreCase(verb, "stats") && second.empty())
+    {
+        command.verb = first.empty() ? Verb::Stats : equalsIgnoreCase(first, "json") ? Verb::StatsJson
+                                                 : equalsIgnoreCase(first, "reset")  ? Verb::StatsReset
+                                                                                     : Verb::Invalid;
+    }
+    else if (first.empty())
+    {
+        if (equalsIgnoreCase(verb, "flush"))
+        {
+            command.verb = Verb::Flush;
+        }
+        else if (equalsIgnoreCase(verb, "compact"))
+        {
+            command.verb = Verb::Compact;
+        }
+        else if (equalsIgnoreCase(verb, "status"))
+        {
+            command.verb = Verb::Status;
+        }
+        else if (equalsIgnoreCase(verb, "help"))
+        {
+            command.verb = Verb::Help;
+        }
+        else if (equalsIgnoreCase(verb, "clear") || equalsIgnoreCase(verb, "cls"))
+        {
+            command.verb = Verb::Clear;
+        }
+        else if (equalsIgnoreCase(verb, "exit"))
+        {
+            command.verb = Verb::Exit;
+        }
+    }
+    if (command.verb == Verb::Invalid)
+    {
+        command.error = invalidCommand;
+    }
+    return command;
+}
+
+// Function to run one command line against the inventory (an Inventory or a ShardedInventory), writing
+// its reply to out; returns false when the command ends the session
+template <typename Store>
+bool runCommand(Store &inventory, string_view line, ostream &out, bool console)
+{
+    ParsedCommand command = parseCommand(line);
+    if (command.error != nullptr)
+    {
+        out << command.error;
+        return true;
+    }
+
+    switch (command.verb)
+    {
+    case Verb::ItemAdd:
+        inventory.addItem(command.id, command.text, command.quantity, command.day, out);
+        break;
+    case Verb::ItemUpdate:
+        inventory.updateItem(command.id, command.quantity, out);
+        break;
+    case Verb::ItemRemove:
+        inventory.removeItem(command.id, out);
+        break;
+    case Verb::ItemsList:
+        inventory.listItems(out);
+        break;
+    case Verb::ItemsListPage:
+        inventory.listItemsPage(command.count, static_cast<size_t>(command.size), out);
+        break;
+    case Verb::ItemsListPrefix:
+        inventory.listItemsWithPrefix(command.text, out);
+        break;
+    case Verb::ItemsFind:
+        inventory.findItem(command.id, out);
+        break;
+    case Verb::ItemsRangeQuantity:
+        inventory.listItemsByQuantity(command.low, command.high, out);
+        break;
+    case Verb::ItemsBetween:
+        inventory.listItemsRegisteredBetween(command.low, command.high, out);
+        break;
+    case Verb::ItemsStats:
+        inventory.printQuantityStats(command.grouped, command.hasThreshold, command.low, out);
+        break;
+    case Verb::ItemImport:
+        inventory.importItems(string(command.text), out);
+        break;
+    case Verb::ExportSnapshot:
+        if (inventory.saveSnapshot(out))
+        {
+            out << "Snapshot written successfully!" << endl;
+        }
+        break;
+    case Verb::ExportCsv:
+        if (inventory.exportCsv(out))
+        {
+            out << "CSV file written successfully!" << endl;
+        }
+        break;
+    case Verb::Flush:
+        if (inventory.flush(out))
+        {
+            out << "Pending items written successfully!" << endl;
+        }
+        break;
+    case Verb::BatchOff:
+        inventory.setWriteBatching(0, chrono::milliseconds(0));
+        out << "Items are now written one at a time." << endl;
+        break;
+    case Verb::Batch:
+        inventory.setWriteBatching(command.count, chrono::milliseconds(command.size));
+        out << "Items are now written in batches of " << command.count << " bytes or every " << command.size << " ms." << endl;
+        break;
+    case Verb::SetDurability:
+        inventory.setDurability(command.durability);
+        out << "Durability set to " << (command.durability == Durability::None ? "none" : command.durability == Durability::Flush ? "flush"
+                                                                                                                                  : "fsync")
+            << "." << endl;
+        break;
+    case Verb::SetOutput:
+        inventory.setOutputFormat(command.format, command.stream);
+        out << "Listings are now printed as " << (command.format == OutputFormat::Plain ? "plain" : command.format == OutputFormat::Aligned ? "aligned"
+                                                                                                 : command.format == OutputFormat::Csv     ? "csv"
+                                                                                                                                           : "json")
+            << (command.stream ? ", streamed." : ", buffered.") << endl;
+        break;
+    case Verb::Compact:
+        if (inventory.compact(false, out))
+        {
+            out << "Log compacted successfully!" << endl;
+        }
+        break;
+    case Verb::Stats:
+    case Verb::StatsJson:
+    case Verb::StatsReset:
+        if (!statsEnabled)
+        {
+            out << "Statistics are disabled in this build." << endl;
+        }
+        else if (command.verb == Verb::StatsReset)
+        {
+            Stats::reset();
+            out << "Statistics reset." << endl;
+        }
+        else if (command.verb == Verb::StatsJson)
+        {
+            Stats::printJson(out);
+        }
+        else
+        {
+            Stats::print(out);
+        }
+        break;
+    case Verb::Status:
+        printLoadStatus(inventory.loadProgress(), out);
+        break;
+    case Verb::Help:
+        displayHelp(out);
+        break;
+    case Verb::Clear:
+        // only the local console can be cleared; remote clients get an empty reply
+        if (console)
+        {
+            clearScreen(); // Clear the console screen
+        }
+        break;
+    case Verb::Exit:
+        return false;
+    case Verb::Invalid:
+        break;
+    }
+    return true;
+}
+
+// Function to tell whether a command reads or changes the items, and so has to wait for a background load
+bool needsLoadedItems(Verb verb)
+{
+    switch (verb)
+    {
+    case Verb::Invalid:
+    case Verb::ItemAdd: // queued while loading
+    case Verb::Flush:
+    case Verb::BatchOff:
+    case Verb::Batch:
+    case Verb::SetDurability:
+    case Verb::SetOutput:
+    case Verb::Stats:
+    case Verb::StatsJson:
+    case Verb::StatsReset:
+    case Verb::Status:
+    case Verb::Help:
+    case Verb::Clear:
+    case Verb::Exit:
+        return false;
+    default:
+        return true;
+    }
+}
+
+// Function to print the outcome of a finished background load, once
+template <typename Store>
+void reportLoad(Store &inventory)
+{
+    string messages;
+    bool found = false;
+    if (inventory.takeLoadReport(messages, found))
+    {
+        cout << messages;
+        if (found)
+        {
+            cout << "Stored Items have been loaded successfully! They are " << inventory.itemCount() << "\n"
+                 << endl;
+        }
+    }
+}
+
+// Function to measure the parse cost of typical command lines in nanoseconds per command
+void runParseBenchmark(size_t iterations)
+{
+    const string_view samples[] = {
+        "itemadd 1042 Notebook 25 2023-06-21",
+        "ITEMADD 7 Pen -1 2023-06-21",
+        "itemupdate 1042 30",
+        "itemremove 1042",
+        "itemslist",
+        "itemslist page 12 50",
+        "itemslist prefix Note",
+        "itemsrange qty 10 20",
+        "durability fsync",
+        "batch 65536 250",
+        "not a command at all",
+    };
+    size_t checksum = 0;
+    for (string_view sample : samples)
+    {
+        auto started = chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            ParsedCommand command = parseCommand(sample);
+            checksum += static_cast<size_t>(command.verb) + static_cast<size_t>(command.id) + command.text.size();
+        }
+        double nanos = chrono::duration<double, nano>(chrono::steady_clock::now() - started).count() / max<size_t>(1, iterations);
+        cout << left << setw(40) << sample << right << setw(8) << fixed << setprecision(1) << nanos << " ns" << defaultfloat << endl;
+    }
+    if (checksum == 1)
+    {
+        cout << endl; // keeps the parses from being optimised away
+    }
+}
+
+// Function to report the peak resident set size of this process in KiB (0 where it is not available)
+size_t peakRssKib()
+{
+#ifdef _WIN32
+    return 0;
+#else
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss) / 1024; // bytes on macOS
+#else
+    return static_cast<size_t>(usage.ru_maxrss);
+#endif
+#endif
+}
+
+// Function to name the kind of a command for the workload report ("itemadd", "itemslist page", ...);
+// words are matched in place, as parseCommand does, and words it does not know are reported as "(other)"
+string commandKind(const string &command)
+{
+    static const char *const verbs[] = {"itemadd", "itemupdate", "itemremove", "itemslist", "itemsfind", "itemsrange",
+                                        "itemsbetween", "itemsstats", "itemimport", "itemsexport", "compact", "flush",
+                                        "batch", "durability", "output", "stats", "status", "help", "cls", "exit"};
+    static const char *const listModes[] = {"page", "prefix", "qty", "date"};
+    string_view rest = command;
+    string_view verb = nextToken(rest);
+    if (verb.empty())
+    {
+        return "(empty)";
+    }
+    for (const char *known : verbs)
+    {
+        if (!equalsIgnoreCase(verb, known))
+        {
+            continue;
+        }
+        string kind = known;
+        string_view mode = nextToken(rest);
+        for (const char *listMode : listModes)
+        {
+            if (kind == "itemslist" && equalsIgnoreCase(mode, listMode))
+            {
+                kind += string(" ") + listMode;
+            }
+        }
+        return kind;
+    }
+    return "(other)";
+}
+
+// Function to print the latency percentiles and a power-of-two histogram of one kind of command
+void reportLatencies(const string &kind, vector<uint64_t> &nanos)
+{
+    sort(nanos.begin(), nanos.end());
+    uint64_t total = 0;
+    uint64_t buckets[64] = {};
+    for (uint64_t sample : nanos)
+    {
+        total += sample;
+        unsigned bucket = 0;
+        while ((sample >> (bucket + 1)) != 0)
+        {
+            bucket += 1;
+        }
+        buckets[bucket] += 1;
+    }
+    auto percentile = [&nanos](double p)
+    {
+        return nanos[min(nanos.size() - 1, static_cast<size_t>(p * nanos.size()))] / 1000.0;
+    };
+    cout << kind << ": " << nanos.size() << " ops, " << static_cast<uint64_t>(nanos.size() / (total / 1e9 + 1e-12))
+         << " ops/sec, p50 " << percentile(0.50) << " us, p99 " << percentile(0.99) << " us, max "
+         << nanos.back() / 1000.0 << " us" << endl;
+    for (unsigned bucket = 0; bucket < 64; ++bucket)
+    {
+        if (buckets[bucket] != 0)
+        {
+            cout << "    < " << setw(10) << (uint64_t(2) << bucket) << " ns: " << setw(9) << buckets[bucket] << " "
+                 << string(static_cast<size_t>(50.0 * buckets[bucket] / nanos.size() + 0.5), '#') << endl;
+        }
+    }
+}
+
+// Name of generated item i; fixed width so a prefix lookup of it matches exactly one item
+string generatedItemName(size_t i)
+{
+    string digits = to_string(i);
+    return "Item" + string(digits.size() < 8 ? 8 - digits.size() : 0, '0') + digits;
+}
+
+// Function to create a scratch directory with an items.csv of `rows` generated items, or a copy of the
+// current items.csv when rows is 0; workloads never touch the real inventory files
+filesystem::path prepareScratchInventory(size_t rows)
+{
+    filesystem::path directory = filesystem::temp_directory_path() / "inventory_workload";
+    filesystem::remove_all(directory);
+    filesystem::create_directories(directory);
+    if (rows == 0)
+    {
+        error_code ec;
+        filesystem::copy_file("items.csv", directory / "items.csv", ec);
+        return directory;
+    }
+    ofstream file(directory / "items.csv");
+    for (size_t i = 0; i < rows; ++i)
+    {
+        // names are scattered so the CSV is not already in name order
+        file << i << "," << generatedItemName((i * 7919) % rows) << "," << i % 1000 << ",2023-01-01\n";
+    }
+    return directory;
+}
+
+// Function to draw an index below n, uniformly or skewed towards small indexes (log-uniform, roughly Zipf)
+size_t drawIndex(uint64_t &state, size_t n, bool zipf)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    double unit = (state >> 11) * (1.0 / 9007199254740992.0);
+    size_t index = zipf ? static_cast<size_t>(pow(static_cast<double>(n) + 1, unit)) - 1 : static_cast<size_t>(unit * n);
+    return min(index, n - 1);
+}
+
+// Function to generate a synthetic workload over a dataset of `rows` generated items: adds use fresh IDs,
+// lists read 20-item pages and lookups search the name of an existing item, picked by the ID distribution.
+// Updates change the quantity of an item picked the same way; removes take the generated items from the
+// highest ID down, so updates only land on removed items once most of them are gone.
+vector<string> generateWorkload(size_t rows, size_t ops, unsigned addShare, unsigned listShare, unsigned lookupShare,
+                                unsigned updateShare, unsigned removeShare, bool zipf)
+{
+    vector<string> commands;
+    commands.reserve(ops);
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    unsigned shares = max(1u, addShare + listShare + lookupShare + updateShare + removeShare);
+    size_t nextId = rows;
+    size_t remaining = rows;
+    size_t pages = max<size_t>(1, rows / 20);
+    for (size_t i = 0; i < ops; ++i)
+    {
+        size_t pick = drawIndex(state, shares, false);
+        if (pick < addShare)
+        {
+            commands.push_back("itemadd " + to_string(nextId) + " " + generatedItemName(nextId) + " " + to_string(nextId % 1000) + " 2024-01-01");
+            nextId += 1;
+        }
+        else if (pick < addShare + listShare)
+        {
+            commands.push_back("itemslist page " + to_string(drawIndex(state, pages, zipf) + 1) + " 20");
+        }
+        else if (pick < addShare + listShare + lookupShare)
+        {
+            commands.push_back("itemslist prefix " + generatedItemName(drawIndex(state, max<size_t>(1, rows), zipf)));
+        }
+        else if (pick < addShare + listShare + lookupShare + updateShare)
+        {
+            size_t id = drawIndex(state, max<size_t>(1, remaining), zipf);
+            commands.push_back("itemupdate " + to_string(id) + " " + to_string(drawIndex(state, 1000, false)));
+        }
+        else
+        {
+            // once every generated item is gone ID 0 is removed again, which reports it missing
+            remaining -= remaining > 0 ? 1 : 0;
+            commands.push_back("itemremove " + to_string(remaining));
+        }
+    }
+    return commands;
+}
+
+// Function to read a JSONL workload; lines that are not commands are counted and skipped
+bool readWorkload(const string &path, vector<string> &commands)
+{
+    MappedFile file(path);
+    if (!file.isOpen())
+    {
+        cout << "Unable to open the file." << endl;
+        return false;
+    }
+    deque<string> decoded;
+    size_t skipped = 0;
+    string_view rest = file.view();
+    while (!rest.empty())
+    {
+        const char *newline = static_cast<const char *>(memchr(rest.data(), '\n', rest.size()));
+        size_t length = newline ? static_cast<size_t>(newline - rest.data()) : rest.size();
+        string_view line = rest.substr(0, length);
+        rest.remove_prefix(newline ? length + 1 : length);
+        string_view command;
+        if (parseJsonCommandLine(line, command, decoded))
+        {
+            commands.emplace_back(command);
+        }
+        else if (line.find_first_not_of(" \t\r") != string_view::npos)
+        {
+            skipped += 1;
+        }
+        decoded.clear();
+    }
+    if (skipped != 0)
+    {
+        cout << "Skipped " << skipped << " lines that hold no command." << endl;
+    }
+    return true;
+}
+
+// Function to write a workload as JSONL, one command string per line
+bool saveWorkload(const string &path, const vector<string> &commands)
+{
+    ofstream file(path);
+    for (const auto &command : commands)
+    {
+        file << '"' << command << "\"\n";
+    }
+    return static_cast<bool>(file);
+}
+
+// Function to run a workload against a scratch inventory with console output discarded, then report the load
+// time, per-command throughput and latency histograms, and the peak RSS
+void runWorkload(const filesystem::path &directory, const vector<string> &commands, StoreKind storeKind)
+{
+    NullBuffer discard;
+    ostream silent(&discard);
+    streambuf *console = cout.rdbuf(&discard);
+    unordered_map<string, vector<uint64_t>> latencies;
+    double loadSeconds = 0;
+    double runSeconds = 0;
+    {
+        Inventory inventory((directory / "items.csv").string(), storeKind);
+        auto started = chrono::steady_clock::now();
+        inventory.loadItems();
+        loadSeconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+        started = chrono::steady_clock::now();
+        for (const auto &command : commands)
+        {
+            auto begin = chrono::steady_clock::now();
+            bool keepGoing = runCommand(inventory, command, silent, false);
+            auto end = chrono::steady_clock::now();
+            latencies[commandKind(command)].push_back(static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(end - begin).count()));
+            if (!keepGoing)
+            {
+                break;
+            }
+        }
+        inventory.flush();
+        runSeconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    }
+    cout.rdbuf(console);
+
+    size_t ran = 0;
+    vector<string> kinds;
+    for (auto &entry : latencies)
+    {
+        ran += entry.second.size();
+        kinds.push_back(entry.first);
+    }
+    sort(kinds.begin(), kinds.end());
+    cout << "load: " << loadSeconds << " s" << endl;
+    for (const auto &kind : kinds)
+    {
+        reportLatencies(kind, latencies[kind]);
+    }
+    cout << "total: " << ran << " ops in " << runSeconds << " s (" << static_cast<uint64_t>(ran / (runSeconds + 1e-12)) << " ops/sec)" << endl;
+    cout << "peak RSS: " << peakRssKib() / 1024.0 << " MiB" << endl;
+    filesystem::remove_all(directory);
+}
+
+// Function to report the current resident set size of this process in KiB (0 where it is not available)
+size_t currentRssKib()
+{
+#ifdef __linux__
+    ifstream statm("/proc/self/statm");
+    size_t pages = 0;
+    size_t resident = 0;
+    statm >> pages >> resident;
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE)) / 1024;
+#else
+    return 0;
+#endif
+}
+
+// The item layout this program started with: every item owns its name and date strings
+struct LegacyItem
+{
+    int itemID;
+    string itemName;
+    int quantity;
+    string registrationDate;
+};
+
+// Function to load a CSV file the way the program originally did: getline, a stringstream per line and
+// owned strings per item
+size_t loadLegacyItems(const string &path, vector<LegacyItem> &items)
+{
+    ifstream file(path);
+    string line;
+    while (getline(file, line))
+    {
+        stringstream ss(line);
+        string token;
+        vector<string> tokens;
+        while (getline(ss, token, ','))
+        {
+            tokens.push_back(token);
+        }
+        if (tokens.size() == 4)
+        {
+            items.push_back(LegacyItem{stoi(tokens[0]), tokens[1], stoi(tokens[2]), tokens[3]});
+        }
+    }
+    return items.size();
+}
+
+// Function to compare the memory per item and load time of the original owned-string layout with the
+// string pool and column table, on a generated items.csv; each layout is measured in its own process
+// where fork() is available so the resident sizes do not mix
+void runMemoryBenchmark(size_t rows)
+{
+    filesystem::path directory = prepareScratchInventory(max<size_t>(1, rows));
+    string csvPath = (directory / "items.csv").string();
+    error_code ec;
+    cout << "rows: " << rows << ", items.csv: " << filesystem::file_size(csvPath, ec) / (1024.0 * 1024.0) << " MiB" << endl;
+
+    for (int layout = 0; layout < 2; ++layout)
+    {
+        cout.flush();
+#ifndef _WIN32
+        pid_t child = fork();
+        if (child > 0)
+        {
+            waitpid(child, nullptr, 0);
+            continue;
+        }
+        if (child < 0)
+        {
+            cout << "Warning: could not start a process for this layout; it is measured in this one, so its resident size may include earlier allocations." << endl;
+        }
+#endif
+        size_t before = currentRssKib();
+        auto started = chrono::steady_clock::now();
+        size_t loaded = 0;
+        size_t after = 0;
+        if (layout == 0)
+        {
+            vector<LegacyItem> items;
+            loaded = loadLegacyItems(csvPath, items);
+            after = currentRssKib();
+        }
+        NullBuffer discard;
+        streambuf *console = cout.rdbuf(&discard);
+        unique_ptr<Inventory> inventory;
+        if (layout == 1)
+        {
+            inventory = make_unique<Inventory>(csvPath);
+            inventory->loadItems();
+            loaded = inventory->itemCount();
+            after = currentRssKib();
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        cout.rdbuf(console);
+        // the resident size can shrink between the readings when freed pages go back to the system
+        double grownKib = after > before ? static_cast<double>(after - before) : 0.0;
+        cout << (layout == 0 ? "owned strings (vector<Item>):  " : "string pool + column table:    ") << "load " << seconds << " s, "
+             << grownKib * 1024.0 / max<size_t>(1, loaded) << " bytes/item (RSS +" << grownKib / 1024.0 << " MiB)" << endl;
+#ifndef _WIN32
+        if (child == 0)
+        {
+            _exit(0);
+        }
+#endif
+    }
+    filesystem::remove_all(directory);
+}
+
+// Function to time the original getline/stringstream loader against the memory-mapped parser, on its
+// own and behind a full Inventory::loadItems, on a generated items.csv
+void runLoadBenchmark(size_t rows)
+{
+    filesystem::path directory = prepareScratchInventory(max<size_t>(1, rows));
+    string csvPath = (directory / "items.csv").string();
+    error_code ec;
+    NullBuffer discard;
+    ostream silent(&discard);
+    auto seconds = [](chrono::steady_clock::time_point started)
+    {
+        return chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    };
+    cout << "rows: " << rows << ", items.csv: " << filesystem::file_size(csvPath, ec) / (1024.0 * 1024.0) << " MiB" << endl;
+
+    auto started = chrono::steady_clock::now();
+    size_t legacyRows = 0;
+    {
+        vector<LegacyItem> items;
+        legacyRows = loadLegacyItems(csvPath, items);
+    }
+    double legacySeconds = seconds(started);
+
+    started = chrono::steady_clock::now();
+    size_t parsedRows = 0;
+    {
+        MappedFile file(csvPath);
+        RecordSink sink;
+        sink.reserve = [](size_t) {};
+        sink.apply = [&parsedRows](const LogRecord *, size_t count)
+        {
+            parsedRows += count;
+        };
+        parseCsvRows(file.view(), 1, sink, silent);
+    }
+    double parseSeconds = seconds(started);
+
+    started = chrono::steady_clock::now();
+    size_t loadedRows = 0;
+    {
+        Inventory inventory(csvPath);
+        inventory.loadItems(silent);
+        loadedRows = inventory.itemCount();
+    }
+    double loadSeconds = seconds(started);
+
+    auto report = [&](const char *label, size_t count, double taken)
+    {
+        cout << label << setw(10) << taken * 1e3 << " ms  " << setw(12) << static_cast<size_t>(count / max(taken, 1e-9))
+             << " rows/s  " << setw(6) << legacySeconds / max(taken, 1e-9) << "x" << endl;
+    };
+    cout << fixed << setprecision(2);
+    report("getline + stringstream:      ", legacyRows, legacySeconds);
+    report("mmap parse, one thread:      ", parsedRows, parseSeconds);
+    report("Inventory::loadItems:        ", loadedRows, loadSeconds);
+    cout << defaultfloat;
+    if (legacyRows != rows || parsedRows != rows || loadedRows != rows)
+    {
+        cout << "Error: the loaders read " << legacyRows << ", " << parsedRows << " and " << loadedRows << " rows." << endl;
+    }
+    filesystem::remove_all(directory);
+}
+
+// Function to time the quantity kernels against a scalar loop over vector<Item>, best of five passes each
+void runAggregateBenchmark(size_t rows)
+{
+    // quantities and dates are scattered over three years, and every 100th row is removed
+    ItemTable table;
+    table.reserve(rows);
+    int32_t firstDay = daysFromCivil(2022, 1, 1);
+    for (size_t i = 0; i < rows; ++i)
+    {
+        table.push_back(static_cast<int32_t>(i), "Item", static_cast<int32_t>((i * 2654435761u) % 1000),
+                        firstDay + static_cast<int32_t>((i * 7919) % 1096));
+        if (i % 100 == 99)
+        {
+            table.remove(i);
+        }
+    }
+    vector<Item> items;
+    items.reserve(table.liveCount());
+    for (size_t slot = 0; slot < table.size(); ++slot)
+    {
+        if (table.isLive(slot))
+        {
+            items.push_back(table.item(slot));
+        }
+    }
+
+    const int32_t threshold = 100;
+    auto best = [](auto pass)
+    {
+        double fastest = 1e300;
+        for (int round = 0; round < 5; ++round)
+        {
+            auto started = chrono::steady_clock::now();
+            pass();
+            fastest = min(fastest, chrono::duration<double, milli>(chrono::steady_clock::now() - started).count());
+        }
+        return fastest;
+    };
+    QuantityStats scalar;
+    double scalarMs = best([&]
+                           {
+        scalar = QuantityStats();
+        for (const Item &item : items)
+        {
+            scalar.add(item.getQuantity(), threshold);
+        } });
+    QuantityStats vectorized;
+    double kernelMs = best([&]
+                           { vectorized = table.quantityStats(threshold); });
+    map<int32_t, QuantityStats> scalarMonths;
+    double scalarMonthMs = best([&]
+                                {
+        scalarMonths.clear();
+        for (const Item &item : items)
+        {
+            unsigned year = 0;
+            unsigned month = 0;
+            unsigned day = 0;
+            civilFromDays(item.getRegistrationDay(), year, month, day);
+            scalarMonths[static_cast<int32_t>(year * 12 + month - 1)].add(item.getQuantity(), threshold);
+        } });
+    vector<pair<int32_t, QuantityStats>> months;
+    double kernelMonthMs = best([&]
+                                {
+        months.clear();
+        table.quantityStatsByMonth(threshold, months); });
+
+    bool same = scalar.count == vectorized.count && scalar.total == vectorized.total && scalar.minimum == vectorized.minimum &&
+                scalar.maximum == vectorized.maximum && scalar.below == vectorized.below && scalarMonths.size() == months.size();
+    for (const auto &month : months)
+    {
+        auto match = scalarMonths.find(month.first);
+        same = same && match != scalarMonths.end() && match->second.total == month.second.total &&
+               match->second.count == month.second.count && match->second.below == month.second.below;
+    }
+    cout << "rows: " << rows << " (" << items.size() << " live), results " << (same ? "match" : "DIFFER") << endl;
+    cout << fixed << setprecision(2);
+    cout << "totals     scalar vector<Item> " << setw(9) << scalarMs << " ms   column kernel " << setw(9) << kernelMs << " ms   "
+         << scalarMs / max(kernelMs, 1e-6) << "x" << endl;
+    cout << "by month   scalar vector<Item> " << setw(9) << scalarMonthMs << " ms   column kernel " << setw(9) << kernelMonthMs << " ms   "
+         << scalarMonthMs / max(kernelMonthMs, 1e-6) << "x" << endl;
+    cout << defaultfloat;
+}
+
+// Function to time two whole-inventory scans, the total quantity and the items registered after a date,
+// over the original owned-string layout and over the column table, best of five passes each
+void runScanBenchmark(size_t rows)
+{
+    ItemTable table;
+    table.reserve(rows);
+    vector<LegacyItem> legacy;
+    legacy.reserve(rows);
+    int32_t firstDay = daysFromCivil(2022, 1, 1);
+    for (size_t i = 0; i < rows; ++i)
+    {
+        string name = generatedItemName(i);
+        int32_t quantity = static_cast<int32_t>((i * 2654435761u) % 1000);
+        int32_t day = firstDay + static_cast<int32_t>((i * 7919) % 1096);
+        table.push_back(static_cast<int32_t>(i), name, quantity, day);
+        legacy.push_back(LegacyItem{static_cast<int>(i), name, quantity, formatDate(day)});
+    }
+    // the dates compare as YYYY-MM-DD strings in the old layout, as the original program kept them
+    const int32_t cutoff = daysFromCivil(2023, 7, 1);
+    const string cutoffText = formatDate(cutoff);
+
+    auto best = [](auto pass)
+    {
+        double fastest = 1e300;
+        for (int round = 0; round < 5; ++round)
+        {
+            auto started = chrono::steady_clock::now();
+            pass();
+            fastest = min(fastest, chrono::duration<double, milli>(chrono::steady_clock::now() - started).count());
+        }
+        return fastest;
+    };
+    int64_t legacyTotal = 0;
+    double legacyTotalMs = best([&]
+                                {
+        legacyTotal = 0;
+        for (const LegacyItem &item : legacy)
+        {
+            legacyTotal += item.quantity;
+        } });
+    int64_t tableTotal = 0;
+    double tableTotalMs = best([&]
+                               { tableTotal = table.totalQuantity(); });
+    size_t legacyAfter = 0;
+    double legacyAfterMs = best([&]
+                                {
+        legacyAfter = 0;
+        for (const LegacyItem &item : legacy)
+        {
+            legacyAfter += item.registrationDate > cutoffText;
+        } });
+    size_t tableAfter = 0;
+    double tableAfterMs = best([&]
+                               { tableAfter = table.countRegisteredAfter(cutoff); });
+
+    bool same = legacyTotal == tableTotal && legacyAfter == tableAfter;
+    auto rate = [rows](double ms)
+    {
+        return rows / max(ms, 1e-6) / 1e3;
+    };
+    cout << "rows: " << rows << ", results " << (same ? "match" : "DIFFER") << endl;
+    cout << fixed << setprecision(2);
+    cout << "total quantity   owned strings " << setw(9) << legacyTotalMs << " ms (" << setw(8) << rate(legacyTotalMs)
+         << " M rows/s)   column table " << setw(9) << tableTotalMs << " ms (" << setw(8) << rate(tableTotalMs) << " M rows/s)   "
+         << legacyTotalMs / max(tableTotalMs, 1e-6) << "x" << endl;
+    cout << "registered after owned strings " << setw(9) << legacyAfterMs << " ms (" << setw(8) << rate(legacyAfterMs)
+         << " M rows/s)   column table " << setw(9) << tableAfterMs << " ms (" << setw(8) << rate(tableAfterMs) << " M rows/s)   "
+         << legacyAfterMs / max(tableAfterMs, 1e-6) << "x" << endl;
+    cout << defaultfloat;
+}
+
+// Function to compare the storage backends on the same generated items: a start-up load, single adds
+// through the inventory, and batched put/scan/get straight against the store, each in a scratch directory
+void runStoreBenchmark(size_t rows)
+{
+    NullBuffer discard;
+    ostream silent(&discard);
+    const size_t ops = max<size_t>(1, min<size_t>(rows, 100000));
+    const size_t batchRows = 1024;
+    auto seconds = [](chrono::steady_clock::time_point started)
+    {
+        return chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    };
+    cout << "rows: " << rows << ", ops: " << ops << endl;
+    cout << left << setw(8) << "store" << right << setw(12) << "load ms" << setw(12) << "add/s" << setw(12) << "put/s"
+         << setw(12) << "scan ms" << setw(12) << "get/s" << endl;
+    for (StoreKind kind : {StoreKind::Csv, StoreKind::Binary, StoreKind::Memory})
+    {
+        filesystem::path directory = prepareScratchInventory(rows);
+        Inventory inventory((directory / "items.csv").string(), kind);
+        // a first load and checkpoint leave every store in the state it starts from on later runs
+        inventory.loadItems(silent);
+        inventory.compact(false, silent);
+
+        auto started = chrono::steady_clock::now();
+        inventory.loadItems(silent);
+        double loadSeconds = seconds(started);
+
+        started = chrono::steady_clock::now();
+        for (size_t i = 0; i < ops; ++i)
+        {
+            inventory.addItem(static_cast<int>(rows + i), generatedItemName(i), 1, 19358, silent);
+        }
+        inventory.flush(silent);
+        double addSeconds = seconds(started);
+
+        ItemStore &store = inventory.storage();
+        vector<string> names(batchRows);
+        vector<LogRecord> batch(batchRows);
+        started = chrono::steady_clock::now();
+        for (size_t done = 0; done < ops; done += batchRows)
+        {
+            size_t count = min(batchRows, ops - done);
+            for (size_t i = 0; i < count; ++i)
+            {
+                names[i] = generatedItemName(done + i);
+                batch[i] = LogRecord{LogOp::Add, static_cast<int32_t>(rows + ops + done + i), 1, 19358, names[i]};
+            }
+            store.put(batch.data(), count);
+        }
+        store.flush();
+        double putSeconds = seconds(started);
+
+        size_t scanned = 0;
+        RecordSink sink;
+        sink.reserve = [](size_t) {};
+        sink.apply = [&scanned](const LogRecord *, size_t count)
+        {
+            scanned += count;
+        };
+        started = chrono::steady_clock::now();
+        store.scan(sink, silent);
+        double scanSeconds = seconds(started);
+
+        // file stores answer a batch with one scan, so they get a handful of large batches
+        size_t lookups = kind == StoreKind::Memory ? ops : min<size_t>(ops, 8 * batchRows);
+        vector<int32_t> ids(batchRows);
+        vector<StoredItem> found;
+        uint64_t state = 88172645463325252ull;
+        size_t hits = 0;
+        started = chrono::steady_clock::now();
+        for (size_t done = 0; done < lookups; done += batchRows)
+        {
+            size_t count = min(batchRows, lookups - done);
+            for (size_t i = 0; i < count; ++i)
+            {
+                ids[i] = static_cast<int32_t>(drawIndex(state, rows + 2 * ops, false));
+            }
+            store.get(ids.data(), count, found, silent);
+            for (const auto &row : found)
+            {
+                hits += row.found ? 1 : 0;
+            }
+        }
+        double getSeconds = seconds(started);
+
+        cout << left << setw(8) << storeKindName(kind) << right << fixed << setprecision(1) << setw(12) << loadSeconds * 1000
+             << setw(12) << static_cast<uint64_t>(ops / (addSeconds + 1e-12)) << setw(12)
+             << static_cast<uint64_t>(ops / (putSeconds + 1e-12)) << setw(12) << scanSeconds * 1000 << setw(12)
+             << static_cast<uint64_t>(lookups / (getSeconds + 1e-12)) << defaultfloat;
+        if (scanned < rows + 2 * ops || hits != lookups)
+        {
+            cout << "   (scanned " << scanned << ", found " << hits << " of " << lookups << ")";
+        }
+        cout << endl;
+    }
+    filesystem::remove_all(filesystem::temp_directory_path() / "inventory_workload");
+}
+
+// Streaming listings read the CSV store's files through fixed-size buffers instead of loading an
+// inventory, so their memory use stays the same however many items the files hold
+
+// Reader that hands out the lines of a file one at a time through a fixed-size buffer
+class LineReader
+{
+private:
+    static constexpr size_t blockSize = 1 << 20;
+    FILE *file = nullptr;
+    vector<char> buffer;
+    size_t begin = 0;
+    size_t end = 0;
+    bool atEnd = false;
+
+public:
+    // Constructor
+    explicit LineReader(const string &path)
+        : file(fopen(path.c_str(), "rb")), buffer(blockSize) {}
+
+    ~LineReader()
+    {
+        if (file != nullptr)
+        {
+            fclose(file);
+        }
+    }
+
+    LineReader(const LineReader &) = delete;
+    LineReader &operator=(const LineReader &) = delete;
+
+    bool isOpen() const
+    {
+        return file != nullptr;
+    }
+
+    // Function to read the next line without its newline; terminated is false for an unterminated last line
+    bool next(string_view &line, bool &terminated)
+    {
+        while (true)
+        {
+            const char *first = buffer.data() + begin;
+            const char *newline = static_cast<const char *>(memchr(first, '\n', end - begin));
+            if (newline != nullptr)
+            {
+                size_t length = static_cast<size_t>(newline - first);
+                line = string_view(first, length);
+                begin += length + 1;
+                terminated = true;
+                return true;
+            }
+            if (atEnd)
+            {
+                if (begin == end)
+                {
+                    return false;
+                }
+                line = string_view(first, end - begin);
+                begin = end;
+                terminated = false;
+                return true;
+            }
+            // keep the partial line at the front and refill behind it; a line longer than the buffer grows it
+            size_t partial = end - begin;
+            memmove(buffer.data(), first, partial);
+            begin = 0;
+            end = partial;
+            if (end == buffer.size())
+            {
+                buffer.resize(buffer.size() * 2);
+            }
+            ScopedTimer timer(Metric::FileRead);
+            size_t got = file != nullptr ? fread(buffer.data() + end, 1, buffer.size() - end, file) : 0;
+            timer.bytes = got;
+            end += got;
+            atEnd = got == 0;
+        }
+    }
+};
+
+// Changes logged for the items of a streaming listing, by ID. The log is folded into the CSV by every
+// compaction, so this holds at most a log's worth of changes whatever the size of the CSV.
+class LoggedChanges
+{
+public:
+    struct Change
+    {
+        LogOp op;
+        int32_t quantity;
+        int32_t date;
+        string name;
+    };
+
+    struct Entry
+    {
+        vector<Change> changes; // oldest first
+        bool resolved = false;  // the ID was already listed or dropped
+    };
+
+private:
+    unordered_map<int32_t, Entry> entries;
+    // IDs in the order they were first logged, so items that only exist in the log list in that order
+    vector<int32_t> order;
+
+public:
+    // Function to add the records of a log; a torn tail is skipped here and cut off by the next full load
+    void read(const string &path)
+    {
+        MappedFile file(path);
+        string_view rest = file.view();
+        LogRecord record;
+        while (decodeLogRecord(rest, record))
+        {
+            auto inserted = entries.try_emplace(record.id);
+            if (inserted.second)
+            {
+                order.push_back(record.id);
+            }
+            inserted.first->second.changes.push_back(Change{record.op, record.quantity, record.date, string(record.name)});
+        }
+    }
+
+    void clear()
+    {
+        entries.clear();
+        order.clear();
+    }
+
+    // Function to look up the changes of an ID; nullptr when it has none
+    Entry *find(int32_t id)
+    {
+        if (entries.empty())
+        {
+            return nullptr;
+        }
+        auto match = entries.find(id);
+        return match == entries.end() ? nullptr : &match->second;
+    }
+
+    // Function to replay the changes of an ID over its stored row, or over no row, the way a load applies
+    // the log; false when no item is left. name may end up pointing into the entry.
+    static bool apply(const Entry &entry, bool present, int32_t &quantity, int32_t &date, string_view &name)
+    {
+        for (const auto &change : entry.changes)
+        {
+            if (change.op == LogOp::Add && !present)
+            {
+                present = true;
+                quantity = change.quantity;
+                date = change.date;
+                name = change.name;
+            }
+            else if (change.op == LogOp::Update && present)
+            {
+                quantity = change.quantity;
+            }
+            else if (change.op == LogOp::Remove)
+            {
+                present = false;
+            }
+        }
+        return present;
+    }
+
+    // Function to visit the items that only exist in the log; false when visit asked to stop
+    template <typename Visit>
+    bool visitUnresolved(Visit visit)
+    {
+        for (int32_t id : order)
+        {
+            Entry &entry = entries[id];
+            if (entry.resolved)
+            {
+                continue;
+            }
+            entry.resolved = true;
+            int32_t quantity = 0;
+            int32_t date = 0;
+            string_view name;
+            if (apply(entry, false, quantity, date, name) && !visit(id, name, quantity, date))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// Function to visit the current items of the CSV store files given, in file order, with the logged
+// changes applied; false when none of them could be opened or visit returned false to stop. A duplicate
+// ID in a CSV is only caught when the log touches it; compaction never writes one.
+template <typename Visit>
+bool streamStoredItems(const vector<string> &csvPaths, Visit visit, ostream &out)
+{
+    bool opened = false;
+    LoggedChanges changes;
+    for (const auto &csvPath : csvPaths)
+    {
+        string logName = filesystem::path(csvPath).replace_extension(".wal").string();
+        changes.clear();
+        changes.read(logName + ".old");
+        changes.read(logName);
+        LineReader reader(csvPath);
+        if (!reader.isOpen() && !filesystem::exists(logName))
+        {
+            continue;
+        }
+        opened = true;
+
+        ScopedTimer timer(Metric::Load);
+        string_view line;
+        bool terminated = true;
+        size_t lineNumber = 0;
+        while (reader.next(line, terminated))
+        {
+            lineNumber += 1;
+            int id = 0;
+            int quantity = 0;
+            string_view name;
+            string_view regDate;
+            int32_t date = 0;
+            if (!parseItemLine(line, id, name, quantity, regDate) || !parseDate(regDate, date))
+            {
+                if (terminated)
+                {
+                    out << "Error: Invalid data in " << csvPath << " on line " << lineNumber << "." << endl;
+                }
+                else
+                {
+                    out << "Warning: ignoring the incomplete last line " << lineNumber << " of " << csvPath << "." << endl;
+                }
+                break;
+            }
+            LoggedChanges::Entry *entry = changes.find(id);
+            if (entry == nullptr)
+            {
+                if (!visit(id, name, quantity, date))
+                {
+                    return false;
+                }
+                continue;
+            }
+            if (!entry->resolved)
+            {
+                entry->resolved = true;
+                if (LoggedChanges::apply(*entry, true, quantity, date, name) && !visit(id, name, quantity, date))
+                {
+                    return false;
+                }
+            }
+        }
+        if (!changes.visitUnresolved(visit))
+        {
+            return false;
+        }
+    }
+    if (!opened)
+    {
+        out << "Unable to open the file." << endl;
+    }
+    return opened;
+}
+
+// Order of a streaming listing
+enum class StreamOrder
+{
+    File, // as stored, nothing held back
+    Name, // by name, ties in file order, like itemslist
+    Id    // by ID
+};
+
+// Fixed part of a row in a sorted run file; the name bytes follow it. seq is the row's position in the
+// stream, which breaks ties the way insertion order does in memory.
+struct RunRecord
+{
+    uint64_t seq;
+    int32_t id;
+    int32_t quantity;
+    int32_t date;
+    uint32_t nameLength;
+};
+
+// Buffered reader over one sorted run file
+class RunReader
+{
+private:
+    FILE *file;
+    vector<char> buffer;
+
+public:
+    RunRecord record{};
+    string name;
+
+    // Constructor
+    explicit RunReader(const string &path)
+        : file(fopen(path.c_str(), "rb")), buffer(64 * 1024)
+    {
+        if (file != nullptr)
+        {
+            setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+        }
+    }
+
+    ~RunReader()
+    {
+        if (file != nullptr)
+        {
+            fclose(file);
+        }
+    }
+
+    RunReader(const RunReader &) = delete;
+    RunReader &operator=(const RunReader &) = delete;
+
+    // Function to read the next row; false at the end of the run
+    bool next()
+    {
+        if (file == nullptr || fread(&record, sizeof(record), 1, file) != 1)
+        {
+            return false;
+        }
+        name.resize(record.nameLength);
+        return record.nameLength == 0 || fread(&name[0], 1, record.nameLength, file) == record.nameLength;
+    }
+};
+
+// Sorts a stream of rows in bounded memory: rows collect in a window, each full window is sorted and
+// spilled to a run file, and the runs are merged back in order at the end. A stream that fits in one
+// window never touches the disk.
+class ExternalSorter
+{
+private:
+    // runs merged at once; more runs are first merged in groups of this many
+    static constexpr size_t maxFanIn = 128;
+
+    struct WindowRow
+    {
+        uint64_t seq;
+        int32_t id;
+        int32_t quantity;
+        int32_t date;
+        uint32_t nameOffset;
+        uint32_t nameLength;
+    };
+
+    StreamOrder order;
+    size_t windowRows;
+    vector<WindowRow> rows;
+    string names;
+    filesystem::path directory;
+    vector<string> runFiles;
+    size_t runsWritten = 0;
+    uint64_t nextSeq = 0;
+    bool writeFailed = false;
+
+    bool before(const RunRecord &a, string_view nameA, const RunRecord &b, string_view nameB) const
+    {
+        if (order == StreamOrder::Name)
+        {
+            int compared = nameA.compare(nameB);
+            if (compared != 0)
+            {
+                return compared < 0;
+            }
+        }
+        else if (a.id != b.id)
+        {
+            return a.id < b.id;
+        }
+        return a.seq < b.seq;
+    }
+
+    string_view nameOf(const WindowRow &row) const
+    {
+        return string_view(names.data() + row.nameOffset, row.nameLength);
+    }
+
+    void sortWindow()
+    {
+        ScopedTimer timer(Metric::Sort);
+        sort(rows.begin(), rows.end(), [this](const WindowRow &a, const WindowRow &b)
+             { return before(RunRecord{a.seq, a.id, 0, 0, 0}, nameOf(a), RunRecord{b.seq, b.id, 0, 0, 0}, nameOf(b)); });
+    }
+
+    // Function to open a new run file for writing
+    FILE *openRun(string &path)
+    {
+        if (runFiles.empty() && runsWritten == 0)
+        {
+            error_code ec;
+            filesystem::create_directories(directory, ec);
+        }
+        path = (directory / ("run" + to_string(runsWritten++))).string();
+        return fopen(path.c_str(), "wb");
+    }
+
+    // Function to sort the window and write it out as a run
+    void spill()
+    {
+        sortWindow();
+        string path;
+        FILE *file = openRun(path);
+        if (file == nullptr)
+        {
+            // the rows are lost either way; keeping them would only make every later add spill again
+            writeFailed = true;
+            rows.clear();
+            names.clear();
+            return;
+        }
+        ScopedTimer timer(Metric::FileWrite);
+        string block;
+        bool ok = true;
+        for (const auto &row : rows)
+        {
+            RunRecord record{row.seq, row.id, row.quantity, row.date, row.nameLength};
+            block.append(reinterpret_cast<const char *>(&record), sizeof(record));
+            block += nameOf(row);
+            if (block.size() >= (1 << 20))
+            {
+                ok = fwrite(block.data(), 1, block.size(), file) == block.size() && ok;
+                timer.bytes += block.size();
+                block.clear();
+            }
+        }
+        ok = fwrite(block.data(), 1, block.size(), file) == block.size() && ok;
+        timer.bytes += block.size();
+        ok = fclose(file) == 0 && ok;
+        writeFailed = writeFailed || !ok;
+        runFiles.push_back(path);
+        rows.clear();
+        names.clear();
+    }
+
+    // Function to merge runs in order, handing each row to emit(record, name)
+    template <typename Emit>
+    void mergeRuns(const vector<string> &files, Emit emit)
+    {
+        vector<unique_ptr<RunReader>> readers;
+        readers.reserve(files.size());
+        for (const auto &file : files)
+        {
+            readers.push_back(make_unique<RunReader>(file));
+        }
+        auto after = [&](size_t a, size_t b)
+        {
+            return before(readers[b]->record, readers[b]->name, readers[a]->record, readers[a]->name);
+        };
+        priority_queue<size_t, vector<size_t>, decltype(after)> heap(after);
+        for (size_t run = 0; run < readers.size(); ++run)
+        {
+            if (readers[run]->next())
+            {
+                heap.push(run);
+            }
+        }
+        while (!heap.empty())
+        {
+            size_t run = heap.top();
+            heap.pop();
+            emit(readers[run]->record, readers[run]->name);
+            if (readers[run]->next())
+            {
+                heap.push(run);
+            }
+        }
+    }
 
 public:
     // Constructor
-    Item(int id, const string &name, int qty, const string &regDate)
-        : itemID(id), itemName(name), quantity(qty), registrationDate(regDate) {}
+    ExternalSorter(StreamOrder sortOrder, size_t window)
+        : order(sortOrder), windowRows(max<size_t>(1, window)),
+          directory(filesystem::temp_directory_path() /
+                    ("inventory_runs_" + to_string(chrono::steady_clock::now().time_since_epoch().count()))) {}
 
-    // Getter methods
-    int getItemID() const
+    ~ExternalSorter()
     {
-        return itemID;
+        error_code ec;
+        filesystem::remove_all(directory, ec);
     }
 
-    string getItemName() const
+    ExternalSorter(const ExternalSorter &) = delete;
+    ExternalSorter &operator=(const ExternalSorter &) = delete;
+
+    size_t runCount() const
     {
-        return itemName;
+        return runsWritten;
     }
 
-    int getQuantity() const
+    bool failed() const
     {
-        return quantity;
+        return writeFailed;
     }
 
-    string getRegistrationDate() const
+    // Function to add a row; the window is spilled once it holds windowRows rows or their names outgrow
+    // 32 bytes a row. False once a run file could not be written, after which the caller should stop.
+    bool add(int32_t id, string_view name, int32_t quantity, int32_t date)
     {
-        return registrationDate;
+        if (rows.size() >= windowRows || names.size() >= windowRows * 32)
+        {
+            spill();
+            if (writeFailed)
+            {
+                return false;
+            }
+        }
+        if (rows.capacity() == 0)
+        {
+            rows.reserve(windowRows);
+        }
+        rows.push_back(WindowRow{nextSeq++, id, quantity, date, static_cast<uint32_t>(names.size()), static_cast<uint32_t>(name.size())});
+        names += name;
+        return true;
     }
 
-    // Function to format item details as a string
-    string toString() const
+    // Function to hand every row to emit(id, name, quantity, date) in order; false when a run file
+    // could not be written
+    template <typename Emit>
+    bool finish(Emit emit)
     {
-        stringstream ss;
-        ss << "Item ID:" << itemID << "\tItem Name:" << itemName;
-        ss << "\tQuantity :" << quantity << "\tReg Date :" << registrationDate;
-        return ss.str();
+        if (runFiles.empty())
+        {
+            sortWindow();
+            for (const auto &row : rows)
+            {
+                emit(row.id, nameOf(row), row.quantity, row.date);
+            }
+            return true;
+        }
+        if (!rows.empty())
+        {
+            spill();
+        }
+        // the window is not needed while merging
+        vector<WindowRow>().swap(rows);
+        string().swap(names);
+        while (runFiles.size() > maxFanIn && !writeFailed)
+        {
+            vector<string> group(runFiles.begin(), runFiles.begin() + maxFanIn);
+            runFiles.erase(runFiles.begin(), runFiles.begin() + maxFanIn);
+            string path;
+            FILE *file = openRun(path);
+            if (file == nullptr)
+            {
+                writeFailed = true;
+                break;
+            }
+            vector<char> buffer(1 << 20);
+            setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+            bool ok = true;
+            mergeRuns(group, [&](const RunRecord &record, const string &name)
+                      { ok = fwrite(&record, sizeof(record), 1, file) == 1 && fwrite(name.data(), 1, name.size(), file) == name.size() && ok; });
+            ok = fclose(file) == 0 && ok;
+            writeFailed = writeFailed || !ok;
+            for (const auto &done : group)
+            {
+                error_code ec;
+                filesystem::remove(done, ec);
+            }
+            runFiles.push_back(path);
+        }
+        if (writeFailed)
+        {
+            return false;
+        }
+        mergeRuns(runFiles, [&](const RunRecord &record, const string &name)
+                  { emit(record.id, string_view(name), record.quantity, record.date); });
+        return true;
     }
 };
 
-// Inventory class representing the inventory system
-class Inventory
+// Function to print every stored item without loading the inventory: in file order straight through,
+// or sorted by name or ID through run files of at most windowRows rows. A summary goes to stderr so
+// the listing itself can be piped.
+int runStreamList(const vector<string> &csvPaths, StreamOrder order, OutputFormat format, size_t windowRows)
 {
-private:
-    vector<Item> items;
-    string fileName;
-
-public:
-    // Constructor
-    Inventory(const string &file)
-        : fileName(file) {}
-
-    // Function to add an item to the inventory
-    void addItem(int item_id, const string &item_name, int item_quantity, const string &item_registration_date)
+    auto started = chrono::steady_clock::now();
+    size_t listed = 0;
+    size_t repeated = 0;
+    size_t runs = 0;
+    bool ok = true;
     {
-        // Check if the ID is already taken in the CSV file
-        ifstream file1(fileName);
-        if (file1.is_open())
+        RowWriter writer(cout, format, true);
+        auto print = [&](int32_t id, string_view name, int32_t quantity, int32_t date)
         {
-            string line;
-            while (getline(file1, line))
+            writer.row(id, name, quantity, date);
+            listed += 1;
+            return true;
+        };
+        if (order == StreamOrder::File)
+        {
+            // aligned columns cannot be sized before the end, so they get room for any ID and typical names
+            writer.setColumns(11, 24);
+            ok = streamStoredItems(csvPaths, print, cerr);
+        }
+        else
+        {
+            ExternalSorter sorter(order, windowRows);
+            size_t longestId = 0;
+            size_t longestName = 0;
+            char digits[16];
+            ok = streamStoredItems(csvPaths, [&](int32_t id, string_view name, int32_t quantity, int32_t date)
+                                   {
+                longestId = max(longestId, static_cast<size_t>(to_chars(digits, digits + sizeof(digits), id).ptr - digits));
+                longestName = max(longestName, name.size());
+                return sorter.add(id, name, quantity, date); },
+                                   cerr);
+            writer.setColumns(longestId, longestName);
+            // in ID order the rows of a repeated ID come together, first occurrence first, so they can be
+            // dropped the way a load drops them
+            bool first = true;
+            int32_t lastId = 0;
+            auto printOnce = [&](int32_t id, string_view name, int32_t quantity, int32_t date)
             {
-                stringstream ss(line);
-                string itemIdStr;
-                getline(ss, itemIdStr, ',');
-                int itemId = stoi(itemIdStr);
-                if (itemId == item_id)
+                if (order == StreamOrder::Id && !first && id == lastId)
                 {
-                    cout << "Error: Item with ID " << item_id << " already exists." << endl;
-                    file1.close();
-                    return;
+                    repeated += 1;
+                    return true;
                 }
+                first = false;
+                lastId = id;
+                return print(id, name, quantity, date);
+            };
+            if (sorter.failed() || (ok && !sorter.finish(printOnce)))
+            {
+                cerr << "Unable to write the file." << endl;
+                ok = false;
             }
-            file1.close();
+            runs = sorter.runCount();
         }
+    }
+    cerr << "Listed " << listed << " items";
+    if (runs != 0)
+    {
+        cerr << " through " << runs << " sorted runs";
+    }
+    if (repeated != 0)
+    {
+        cerr << ", skipped " << repeated << " rows with a repeated ID";
+    }
+    cerr << " in " << chrono::duration<double>(chrono::steady_clock::now() - started).count() << " s, peak RSS "
+         << peakRssKib() / 1024.0 << " MiB" << endl;
+    return ok ? 0 : 1;
+}
 
-        Item item(item_id, item_name, item_quantity, item_registration_date);
-        ofstream file(fileName, ios::app);
-        if (file.is_open())
+#ifdef __linux__
+// Server mode speaks the console protocol: one command per line, each reply followed by a line holding
+// a single "." so clients can pipeline commands and still tell the replies apart
+volatile sig_atomic_t serverStopping = 0;
+
+// Function to ask the server loop to stop after the current round of events
+void stopServer(int)
+{
+    serverStopping = 1;
+}
+
+// Function to open a socket for "<port>", "<host>:<port>" or "unix:<path>", listening or connected
+int openSocket(const string &address, bool listening)
+{
+    int fd = -1;
+    if (address.rfind("unix:", 0) == 0)
+    {
+        sockaddr_un where{};
+        where.sun_family = AF_UNIX;
+        string path = address.substr(5);
+        if (path.empty() || path.size() >= sizeof(where.sun_path))
         {
-            file << item_id << "," << item_name << "," << item_quantity << "," << item_registration_date << "\n";
-            file.close();
-            // add item to existing items
-            items.push_back(item);
-            cout << "Item saved successfully!" << endl;
+            return -1;
         }
-        else
+        memcpy(where.sun_path, path.c_str(), path.size() + 1);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            return -1;
+        }
+        if (listening)
+        {
+            unlink(path.c_str());
+        }
+        int status = listening ? ::bind(fd, reinterpret_cast<sockaddr *>(&where), sizeof(where))
+                               : connect(fd, reinterpret_cast<sockaddr *>(&where), sizeof(where));
+        if (status != 0 || (listening && listen(fd, SOMAXCONN) != 0))
         {
-            cout << "Unable to open the file." << endl;
+            close(fd);
+            return -1;
         }
+        return fd;
     }
 
-    // Function to list items in ascending order of their ID
-    void listItems()
+    // TCP defaults to the loopback interface so the inventory is not exposed by accident
+    size_t colon = address.rfind(':');
+    string host = colon == string::npos ? "127.0.0.1" : address.substr(0, colon);
+    string port = colon == string::npos ? address : address.substr(colon + 1);
+    sockaddr_in where{};
+    where.sin_family = AF_INET;
+    unsigned number = 0;
+    auto [end, ec] = from_chars(port.data(), port.data() + port.size(), number);
+    if (ec != errc() || end != port.data() + port.size() || number > 65535 || inet_pton(AF_INET, host.c_str(), &where.sin_addr) != 1)
     {
-        // Load items from the CSV file
-        loadItems();
-
-        // Check if there are any items and display a message if not
-        if (items.empty())
-        {
-            cout << "No items are recorded yet." << endl;
-            return;
-        }
+        return -1;
+    }
+    where.sin_port = htons(static_cast<uint16_t>(number));
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, listening ? SOL_SOCKET : IPPROTO_TCP, listening ? SO_REUSEADDR : TCP_NODELAY, &one, sizeof(one));
+    int status = listening ? ::bind(fd, reinterpret_cast<sockaddr *>(&where), sizeof(where))
+                           : connect(fd, reinterpret_cast<sockaddr *>(&where), sizeof(where));
+    if (status != 0 || (listening && listen(fd, SOMAXCONN) != 0))
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
 
-        // Sort items in ascending order of their name
-        sort(items.begin(), items.end(), [](const Item &a, const Item &b)
-             { return a.getItemName() < b.getItemName(); });
+// State of one client connection of the server
+struct Connection
+{
+    string input;
+    string output;
+    size_t sent = 0;
+    bool closing = false;
+};
 
-        // Display items by looping through the vector
-        for (const auto &item : items)
-        {
-            cout << item.toString() << endl;
-        }
+// Function to serve the inventory on a socket with a single-threaded epoll loop until SIGINT or SIGTERM;
+// every connection shares the one in-memory inventory
+template <typename Store>
+bool runServer(Store &inventory, const string &address)
+{
+    const size_t maxLineLength = 1 << 20;
+    int listener = openSocket(address, true);
+    if (listener < 0)
+    {
+        cout << "Unable to listen on " << address << "." << endl;
+        return false;
     }
+    fcntl(listener, F_SETFL, O_NONBLOCK);
+    int poller = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = listener;
+    epoll_ctl(poller, EPOLL_CTL_ADD, listener, &event);
+    signal(SIGINT, stopServer);
+    signal(SIGTERM, stopServer);
+    cout << "Serving the inventory on " << address << " (Ctrl+C to stop)." << endl;
 
-    // Function to load items from a file
-    void loadItems()
+    unordered_map<int, Connection> connections;
+    ostringstream reply;
+    epoll_event events[64];
+    while (!serverStopping)
     {
-        items.clear();
-        int itemNumber = 0;
-        ifstream file(fileName);
-        if (file.is_open())
+        // wake up regularly so time-based write batches are flushed even when clients are idle
+        int ready = epoll_wait(poller, events, 64, 100);
+        inventory.flushIfDue();
+        reportLoad(inventory);
+        for (int e = 0; e < ready; ++e)
         {
-            string line;
-            while (getline(file, line))
+            int fd = events[e].data.fd;
+            if (fd == listener)
             {
-                stringstream ss(line);
-                string token;
-                vector<string> tokens;
-                while (getline(ss, token, ','))
+                int client;
+                while ((client = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
                 {
-                    tokens.push_back(token);
+                    int one = 1;
+                    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                    event.events = EPOLLIN | EPOLLRDHUP;
+                    event.data.fd = client;
+                    epoll_ctl(poller, EPOLL_CTL_ADD, client, &event);
+                    connections[client];
                 }
-                if (tokens.size() == 4)
+                continue;
+            }
+
+            Connection &connection = connections[fd];
+            bool peerClosed = (events[e].events & (EPOLLHUP | EPOLLERR)) != 0;
+            if (events[e].events & (EPOLLIN | EPOLLRDHUP))
+            {
+                char buffer[16384];
+                ssize_t received;
+                while ((received = recv(fd, buffer, sizeof(buffer), 0)) > 0)
                 {
-                    int id = stoi(tokens[0]);
-                    string name = tokens[1];
-                    int quantity = stoi(tokens[2]);
-                    string regDate = tokens[3];
-                    Item item(id, name, quantity, regDate);
-                    itemNumber += 1;
-                    items.push_back(item);
+                    connection.input.append(buffer, static_cast<size_t>(received));
                 }
-                else
+                peerClosed = peerClosed || received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+            }
+
+            // run every complete command that has arrived; the replies go out together in one write
+            size_t consumed = 0;
+            size_t newline;
+            while (!connection.closing && (newline = connection.input.find('\n', consumed)) != string::npos)
+            {
+                string command = connection.input.substr(consumed, newline - consumed);
+                consumed = newline + 1;
+                if (!command.empty() && command.back() == '\r')
+                {
+                    command.pop_back();
+                }
+                reply.str("");
+                connection.closing = !runCommand(inventory, command, reply, false);
+                connection.output += reply.str();
+                connection.output += ".\n";
+            }
+            connection.input.erase(0, consumed);
+            if (connection.input.size() > maxLineLength)
+            {
+                connection.closing = true;
+            }
+
+            while (connection.sent < connection.output.size())
+            {
+                ssize_t written = send(fd, connection.output.data() + connection.sent, connection.output.size() - connection.sent, MSG_NOSIGNAL);
+                if (written <= 0)
                 {
-                    cout << "Error: Invalid data in the file." << endl;
+                    peerClosed = peerClosed || (errno != EAGAIN && errno != EWOULDBLOCK);
                     break;
                 }
+                connection.sent += static_cast<size_t>(written);
             }
-            file.close();
-            cout << "Stored Items have been loaded successfully! They are "
-                 << itemNumber << "\n"
-                 << endl;
-        }
-        else
-        {
-            cout << "Unable to open the file." << endl;
+            bool drained = connection.sent == connection.output.size();
+            if (drained)
+            {
+                connection.output.clear();
+                connection.sent = 0;
+            }
+            if (peerClosed || (drained && connection.closing))
+            {
+                epoll_ctl(poller, EPOLL_CTL_DEL, fd, nullptr);
+                close(fd);
+                connections.erase(fd);
+                continue;
+            }
+            // only ask for writability while a reply is still queued
+            event.events = EPOLLIN | EPOLLRDHUP | (drained ? 0u : static_cast<uint32_t>(EPOLLOUT));
+            event.data.fd = fd;
+            epoll_ctl(poller, EPOLL_CTL_MOD, fd, &event);
         }
     }
-};
 
-// Function to clear the console screen
-void clearScreen()
-{
-#ifdef _WIN32
-    system("cls"); // For Windows
-#else
-    system("clear"); // For Linux and macOS
-#endif
+    for (auto &entry : connections)
+    {
+        close(entry.first);
+    }
+    close(poller);
+    close(listener);
+    if (address.rfind("unix:", 0) == 0)
+    {
+        unlink(address.substr(5).c_str());
+    }
+    cout << "Server stopped." << endl;
+    return true;
 }
 
-// Function to display help
-void displayHelp()
+// Function to load-test a running server from localhost: each connection sends read-only page listings,
+// a window of pipelined commands at a time, and the latency of every reply is recorded
+bool runLoadTest(const string &address, unsigned connections, size_t requests, size_t pipeline)
 {
-    cout << "--------------------------------------\n";
-    cout << "*       Commands syntaxes              *\n";
-    cout << "--------------------------------------\n";
-    cout << "itemadd <item_id> <item_name> <quantity> <registration_date>\n";
-    cout << "itemslist\n";
-    cout << "help\n";
-    cout << "exit\n";
-}
+    vector<vector<double>> latencies(connections);
+    atomic<bool> failed{false};
+    vector<thread> clients;
+    auto started = chrono::steady_clock::now();
+    for (unsigned c = 0; c < connections; ++c)
+    {
+        clients.emplace_back([&, c]
+                             {
+            int fd = openSocket(address, false);
+            if (fd < 0)
+            {
+                failed = true;
+                return;
+            }
+            vector<chrono::steady_clock::time_point> sentAt;
+            string batch;
+            string pending;
+            char buffer[65536];
+            latencies[c].reserve(requests);
+            for (size_t done = 0; done < requests && !failed;)
+            {
+                size_t window = min(pipeline, requests - done);
+                batch.clear();
+                for (size_t i = 0; i < window; ++i)
+                {
+                    batch += "itemslist page " + to_string((done + i) % 50 + 1) + " 10\n";
+                }
+                sentAt.assign(window, chrono::steady_clock::now());
+                if (send(fd, batch.data(), batch.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(batch.size()))
+                {
+                    failed = true;
+                    break;
+                }
+                // a reply ends with a line holding a single "."
+                size_t answered = 0;
+                while (answered < window)
+                {
+                    ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+                    if (received <= 0)
+                    {
+                        failed = true;
+                        break;
+                    }
+                    auto now = chrono::steady_clock::now();
+                    pending.append(buffer, static_cast<size_t>(received));
+                    size_t start = 0;
+                    size_t newline;
+                    while ((newline = pending.find('\n', start)) != string::npos)
+                    {
+                        if (newline - start == 1 && pending[start] == '.')
+                        {
+                            latencies[c].push_back(chrono::duration<double, micro>(now - sentAt[answered]).count());
+                            answered += 1;
+                        }
+                        start = newline + 1;
+                    }
+                    pending.erase(0, start);
+                }
+                done += window;
+            }
+            close(fd); });
+    }
+    for (auto &client : clients)
+    {
+        client.join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    if (failed)
+    {
+        cout << "Unable to talk to the server at " << address << "." << endl;
+        return false;
+    }
 
-// Function to convert a string to lowercase
-string toLowercase(const string &str)
-{
-    string lowercaseStr = str;
-    transform(lowercaseStr.begin(), lowercaseStr.end(), lowercaseStr.begin(), ::tolower);
-    return lowercaseStr;
+    vector<double> all;
+    for (auto &samples : latencies)
+    {
+        all.insert(all.end(), samples.begin(), samples.end());
+    }
+    sort(all.begin(), all.end());
+    auto percentile = [&all](double p)
+    {
+        return all.empty() ? 0.0 : all[min(all.size() - 1, static_cast<size_t>(p * all.size()))];
+    };
+    cout << all.size() << " requests over " << connections << " connection(s), pipeline " << pipeline << ", in "
+         << seconds << " s" << endl;
+    cout << "ops/sec: " << static_cast<uint64_t>(all.size() / seconds) << endl;
+    cout << "latency p50: " << percentile(0.50) << " us, p99: " << percentile(0.99) << " us, max: "
+         << (all.empty() ? 0.0 : all.back()) << " us" << endl;
+    return true;
 }
+#endif
 
-// function to check if a date is valid
-bool isValidDate(const string &dateStr, const string &format)
+// Function to run the console session (or the import or server mode chosen at start-up) on an inventory
+template <typename Store>
+int runSession(Store &inventory, unsigned loadThreads, size_t compactThreshold, const string &importFile, const string &serveAddress)
 {
-    tm tm = {};
-    istringstream ss(dateStr);
-    ss >> get_time(&tm, format.c_str());
-    return !ss.fail();
-}
+    if (compactThreshold != SIZE_MAX)
+    {
+        inventory.setCompactThreshold(compactThreshold);
+    }
+    inventory.setLoadThreads(loadThreads);
 
-int main()
-{
-    try
+    string command;
+    cout << "--------------------------------------" << endl;
+    cout << "*       RCA INVENTORY SYSTEM            *" << endl;
+    cout << "--------------------------------------" << endl;
+    cout << "Developed and maintained by: SW Engineer. ISITE Yves" << endl;
+
+    // a sharded inventory first checks its layout, splitting an unsharded items.csv on first use
+    if constexpr (is_same_v<Store, ShardedInventory>)
     {
-        // create an inventory object instance and also pass the CSV file name
-        Inventory inventory("items.csv");
+        if (!inventory.openLayout())
+        {
+            return 1;
+        }
+    }
 
-        string command;
-        cout << "--------------------------------------" << endl;
-        cout << "*       RCA INVENTORY SYSTEM            *" << endl;
-        cout << "--------------------------------------" << endl;
-        cout << "Developed and maintained by: SW Engineer. ISITE Yves" << endl;
+    // load items in the background so the prompt comes up straight away; the user is told once they are ready
+    inventory.startLoading();
 
-        // load items from the file and tell the user when they are ready
-        inventory.loadItems();
+    // non-interactive bulk import: import, persist and leave without starting the prompt
+    if (!importFile.empty())
+    {
+        inventory.awaitLoad();
+        reportLoad(inventory);
+        bool imported = inventory.importItems(importFile);
+        inventory.saveSnapshotIfStale();
+        return imported ? 0 : 1;
+    }
+
+    // server mode: answer the same commands over a socket instead of the console
+    if (!serveAddress.empty())
+    {
+#ifdef __linux__
+        bool served = runServer(inventory, serveAddress);
+        inventory.awaitLoad();
+        inventory.flush();
+        inventory.saveSnapshotIfStale();
+        return served ? 0 : 1;
+#else
+        cout << "Server mode is only available on Linux." << endl;
+        return 1;
+#endif
+    }
 
-        // display help about supported commands and their syntaxes
-        displayHelp();
+    // display help about supported commands and their syntaxes
+    displayHelp();
 
-        while (true)
+    while (true)
+    {
+        cout << "\nEnter a command> ";
+        getline(cin, command);
+        // a batch whose time threshold passed while waiting for input is written now
+        inventory.flushIfDue();
+        // commands that need the items wait for the load here, so its report comes before their output
+        if (needsLoadedItems(parseCommand(command).verb))
+        {
+            inventory.awaitLoad();
+        }
+        reportLoad(inventory);
+
+        if (!runCommand(inventory, command, cout, true))
         {
-            cout << "\nEnter a command> ";
-            getline(cin, command);
+            cout << "Exiting the program...\n";
+            // adds queued during a load are only saved once it finishes
+            inventory.awaitLoad();
+            inventory.flush();
+            inventory.saveSnapshotIfStale();
+            break;
+        }
+    }
+    return 0;
+}
 
-            // handle different cases according to the entered command (case insensitive)
-            if (toLowercase(command) == "itemadd" || toLowercase(command.substr(0, 8)) == "itemadd ")
+int main(int argc, char *argv[])
+{
+    try
+    {
+        // optional start-up flags
+        unsigned loadThreads = 1;
+        size_t compactThreshold = SIZE_MAX; // SIZE_MAX keeps the default
+        size_t shardCount = 1;
+        StoreKind storeKind = StoreKind::Csv;
+        bool streamList = false;
+        StreamOrder streamOrder = StreamOrder::Name;
+        OutputFormat streamFormat = OutputFormat::Plain;
+        size_t streamWindow = 1000000;
+        string importFile;
+        string serveAddress;
+        unique_ptr<StatsExporter> statsExporter;
+        for (int i = 1; i < argc; ++i)
+        {
+            string flag = argv[i];
+            if (flag == "--load-threads" && i + 1 < argc)
+            {
+                loadThreads = static_cast<unsigned>(stoul(argv[++i]));
+            }
+            else if (flag == "--compact-threshold" && i + 1 < argc)
+            {
+                compactThreshold = stoul(argv[++i]);
+            }
+            else if (flag == "--stress" && i + 1 < argc)
             {
-                if (toLowercase(command) == "itemadd")
+                // --stress <max_readers> [rows] [seconds_per_step]
+                unsigned readers = static_cast<unsigned>(stoul(argv[++i]));
+                size_t rows = i + 1 < argc && argv[i + 1][0] != '-' ? stoul(argv[++i]) : 1000000;
+                double seconds = i + 1 < argc && argv[i + 1][0] != '-' ? stod(argv[++i]) : 2.0;
+                runStressBenchmark(rows, readers, seconds);
+                return 0;
+            }
+            else if (flag == "--shards" && i + 1 < argc)
+            {
+                shardCount = max<size_t>(1, stoul(argv[++i]));
+            }
+            else if (flag == "--store" && i + 1 < argc)
+            {
+                if (!parseStoreKind(argv[++i], storeKind))
                 {
-                    cout << "Invalid format. Enter data in the following format:\n";
-                    cout << "itemadd <item_id> <item_name> <quantity> <registration_date>\n";
-                    continue;
+                    cout << "Unknown store: " << argv[i] << " (expected csv, binary or memory)" << endl;
+                    return 1;
                 }
-                string addCommand = command.substr(8);
-                size_t firstSpacePos = addCommand.find(' ');
-                size_t secondSpacePos = addCommand.find(' ', firstSpacePos + 1);
-                size_t thirdSpacePos = addCommand.find(' ', secondSpacePos + 1);
-
-                if (firstSpacePos != string::npos && secondSpacePos != string::npos)
+            }
+            else if (flag == "--store-bench")
+            {
+                runStoreBenchmark(i + 1 < argc && argv[i + 1][0] != '-' ? stoul(argv[++i]) : 1000000);
+                return 0;
+            }
+            else if (flag == "--stream-list")
+            {
+                // --stream-list [name|id|file] [plain|aligned|csv|json] [window_rows]; runs once every option is read
+                streamList = true;
+                while (i + 1 < argc && argv[i + 1][0] != '-')
                 {
-                    int id = 0;
-
-                    try
+                    string value = argv[++i];
+                    if (value == "name" || value == "id" || value == "file")
                     {
-                        id = stoi(addCommand.substr(0, firstSpacePos));
-                        // check if the ID is a positive integer
-                        if (id < 0)
-                        {
-                            cout << "Error: Invalid ID.Must be a positive integer" << endl;
-                            continue;
-                        }
+                        streamOrder = value == "name" ? StreamOrder::Name : value == "id" ? StreamOrder::Id : StreamOrder::File;
                     }
-                    catch (const exception &e)
+                    else if (value == "plain" || value == "aligned" || value == "csv" || value == "json")
                     {
-                        // display an error message
-                        cout << "Error: Invalid ID.Must be a valid integer" << endl;
-                        // continue because user entered invalid data
-                        continue;
+                        streamFormat = value == "plain" ? OutputFormat::Plain : value == "aligned" ? OutputFormat::Aligned
+                                                                            : value == "csv"     ? OutputFormat::Csv
+                                                                                                 : OutputFormat::Json;
                     }
-
-                    string name = addCommand.substr(firstSpacePos + 1, secondSpacePos - firstSpacePos - 1);
-                    int quantity = 0;
-
-                    try
+                    else
                     {
-                        quantity = stoi(addCommand.substr(secondSpacePos + 1, thirdSpacePos - secondSpacePos - 1));
-                        // check if the quantity is a positive integer
-                        if (quantity < 0)
-                        {
-                            cout << "Error: Invalid quantity.Must be a positive integer" << endl;
-                            continue;
-                        }
+                        streamWindow = stoul(value);
+                    }
+                }
+            }
+            else if (flag == "--import" && i + 1 < argc)
+            {
+                importFile = argv[++i];
+            }
+            else if (flag == "--replay" && i + 1 < argc)
+            {
+                // --replay <workload.jsonl> [rows]: rows 0 replays against a copy of items.csv
+                string path = argv[++i];
+                size_t rows = i + 1 < argc && argv[i + 1][0] != '-' ? stoul(argv[++i]) : 0;
+                vector<string> commands;
+                if (!readWorkload(path, commands))
+                {
+                    return 1;
+                }
+                runWorkload(prepareScratchInventory(rows), commands, storeKind);
+                return 0;
+            }
+            else if (flag == "--workload" && i + 2 < argc)
+            {
+                // --workload <rows> <ops> [add:list:lookup[:update:remove]] [uniform|zipf] [save.jsonl]
+                size_t rows = stoul(argv[++i]);
+                size_t ops = stoul(argv[++i]);
+                unsigned shares[5] = {50, 20, 30, 0, 0};
+                bool zipf = false;
+                string savePath;
+                while (i + 1 < argc && argv[i + 1][0] != '-')
+                {
+                    string value = argv[++i];
+                    if (value == "uniform" || value == "zipf")
+                    {
+                        zipf = value == "zipf";
                     }
-                    catch (const exception &e)
+                    else if (value.find(':') != string::npos)
                     {
-                        // display an error message
-                        cout << "Error: Invalid quantity.Must be a valid integer." << endl;
-                        // continue because user entered invalid data
-                        continue;
+                        stringstream mix(value);
+                        string share;
+                        for (int k = 0; k < 5 && getline(mix, share, ':'); ++k)
+                        {
+                            shares[k] = static_cast<unsigned>(stoul(share));
+                        }
                     }
-
-                    string regDate = addCommand.substr(thirdSpacePos + 1);
-                    // Validate regDate as a valid date (format: YYYY-MM-DD)
-                    if (!isValidDate(regDate, "%Y-%m-%d"))
+                    else
                     {
-                        cout << "Invalid date format. Please enter the date in the format YYYY-MM-DD." << endl;
-                        continue;
+                        savePath = value;
                     }
-
-                    // Call the recordDiseaseCases function with the provided arguments
-                    inventory.addItem(id, name, quantity, regDate);
+                }
+                vector<string> commands = generateWorkload(rows, ops, shares[0], shares[1], shares[2], shares[3], shares[4], zipf);
+                if (!savePath.empty() && !saveWorkload(savePath, commands))
+                {
+                    cout << "Unable to write the file." << endl;
+                    return 1;
+                }
+                runWorkload(prepareScratchInventory(rows), commands, storeKind);
+                return 0;
+            }
+            else if (flag == "--stats-file" && i + 1 < argc)
+            {
+                // --stats-file <path> [seconds]: append a JSON line of statistics every few seconds and on exit
+                string path = argv[++i];
+                long seconds = i + 1 < argc && argv[i + 1][0] != '-' ? stol(argv[++i]) : 10;
+                statsExporter = make_unique<StatsExporter>(path, chrono::seconds(max(1L, seconds)));
+            }
+            else if (flag == "--memory-bench")
+            {
+                runMemoryBenchmark(i + 1 < argc && argv[i + 1][0] != '-' ? stoul(argv[++i]) : 10000000);
+                return 0;
+            }
+            else if (flag == "--load-bench")
+            {
+                // --load-bench [rows]: 10K, 1M and 10M rows unless a size is given
+                if (i + 1 < argc && argv[i + 1][0] != '-')
+                {
+                    runLoadBenchmark(stoul(argv[++i]));
                 }
                 else
                 {
-                    cout << "Invalid format. Enter data in the following format:\n";
-                    cout << "itemadd <item_id> <item_name> <quantity> <registration_date>\n";
+                    runLoadBenchmark(10000);
+                    runLoadBenchmark(1000000);
+                    runLoadBenchmark(10000000);
                 }
+                return 0;
             }
-
-            else if (toLowercase(command) == "itemslist")
+            else if (flag == "--aggregate-bench")
             {
-                inventory.listItems();
+                // --aggregate-bench [rows]: 1M and 10M rows unless a size is given
+                if (i + 1 < argc && argv[i + 1][0] != '-')
+                {
+                    runAggregateBenchmark(stoul(argv[++i]));
+                }
+                else
+                {
+                    runAggregateBenchmark(1000000);
+                    runAggregateBenchmark(10000000);
+                }
+                return 0;
             }
-            else if (toLowercase(command) == "help")
+            else if (flag == "--scan-bench")
             {
-                displayHelp();
+                // --scan-bench [rows]: 1M and 10M rows unless a size is given
+                if (i + 1 < argc && argv[i + 1][0] != '-')
+                {
+                    runScanBenchmark(stoul(argv[++i]));
+                }
+                else
+                {
+                    runScanBenchmark(1000000);
+                    runScanBenchmark(10000000);
+                }
+                return 0;
             }
-            else if (
-                toLowercase(command) == "clear" || toLowercase(command) == "clear " || toLowercase(command) == "cls" || toLowercase(command) == "cls ")
+            else if (flag == "--parse-bench")
             {
-                clearScreen(); // Clear the console screen
+                runParseBenchmark(i + 1 < argc && argv[i + 1][0] != '-' ? stoul(argv[++i]) : 1000000);
+                return 0;
             }
-            else if (
-                toLowercase(command) == "exit")
+            else if (flag == "--serve" && i + 1 < argc)
             {
-                cout << "Exiting the program...\n";
-                break;
+                serveAddress = argv[++i];
+            }
+            else if (flag == "--loadtest" && i + 1 < argc)
+            {
+                // --loadtest <address> [connections] [requests_per_connection] [pipeline_depth]
+                string address = argv[++i];
+                unsigned connections = i + 1 < argc && argv[i + 1][0] != '-' ? static_cast<unsigned>(stoul(argv[++i])) : 4;
+                size_t requests = i + 1 < argc && argv[i + 1][0] != '-' ? stoul(argv[++i]) : 10000;
+                size_t pipeline = i + 1 < argc && argv[i + 1][0] != '-' ? stoul(argv[++i]) : 16;
+#ifdef __linux__
+                return runLoadTest(address, max(1u, connections), requests, max<size_t>(1, pipeline)) ? 0 : 1;
+#else
+                cout << "The load test is only available on Linux." << endl;
+                return 1;
+#endif
             }
             else
             {
-                cout << "Invalid command. Please try again.\n";
+                cout << "Unknown option: " << flag << endl;
+                return 1;
+            }
+        }
+
+        // a streaming list reads the files of the CSV store directly and never loads the inventory
+        if (streamList)
+        {
+            if (storeKind != StoreKind::Csv)
+            {
+                cout << "Streaming lists read the csv store's files only." << endl;
+                return 1;
             }
+            vector<string> paths;
+            for (size_t part = 0; part < shardCount; ++part)
+            {
+                paths.push_back(shardCount > 1 ? shardFileName("items.csv", part) : "items.csv");
+            }
+            return runStreamList(paths, streamOrder, streamFormat, streamWindow);
+        }
+
+        // create an inventory object instance and also pass the CSV file name
+        if (shardCount > 1)
+        {
+            ShardedInventory inventory("items.csv", shardCount, storeKind);
+            return runSession(inventory, loadThreads, compactThreshold, importFile, serveAddress);
         }
+        Inventory inventory("items.csv", storeKind);
+        return runSession(inventory, loadThreads, compactThreshold, importFile, serveAddress);
     }
     // catch any error that may occur
     catch (const exception &e)
     {
-        // store the error in file called logs.txt
+        // store the error in file called logs.txt, stamped and followed by the statistics gathered so far
         ofstream file("logs.txt", ios::app);
         if (file.is_open())
         {
-            file << e.what() << "\n";
+            time_t now = time(nullptr);
+            char stamp[32];
+            strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
+            file << stamp << " error: " << e.what() << "\n";
+            if (statsEnabled)
+            {
+                Stats::printJson(file);
+            }
             file.close();
         }
     }